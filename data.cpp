@@ -3,19 +3,33 @@
 #include <string>
 
 Token::Token() :
-	row(0),
-	col(0),
 	index(0),
-	sourceCodePtr(nullptr)
+	sourceId(SourceCode::noSourceId)
 {}
 
-Token::Token(int _row, int _col, int _index, struct SourceCode* _sourceCodePtr) :
-	row(_row),
-	col(_col),
-	index(_index),
-	sourceCodePtr(_sourceCodePtr)
+Token::Token(int _index, unsigned short _sourceId) :
+	index((unsigned int)_index),
+	sourceId(_sourceId)
 {}
 
+SourceCode* Token::Source() const
+{
+	return SourceCode::Get(sourceId);
+}
+
+void Token::PrintError(const std::string& message) const
+{
+	// a value can outlive the script it was parsed from, its error then has no place to point at
+	SourceCode* source = Source();
+	if (source == nullptr || index > source->text.size())
+	{
+		LogError(message);
+		return;
+	}
+
+	source->PrintError(*this, message);
+}
+
 Data::Data()
 {
 	type = DataType::Bool;
@@ -45,10 +59,15 @@ bool Data::AffirmSameType(Data* other)
 		"string",
 		"list",
 		"map",
-		"function"
+		"function",
+		"deque",
+		"object",
+		"slice",
+		"set",
+		"ordered_map"
 	};
 
-	token.sourceCodePtr->PrintError(token, "type mismatch between " + names[(int)other->type] + " and " + names[(int)type]);
+	token.PrintError("type mismatch between " + names[(int)other->type] + " and " + names[(int)type]);
 	return false;
 }
 
@@ -65,9 +84,14 @@ bool Data::AffirmSameType(DataType _type)
 		"string",
 		"list",
 		"map",
-		"function"
+		"function",
+		"deque",
+		"object",
+		"slice",
+		"set",
+		"ordered_map"
 	};
 
-	token.sourceCodePtr->PrintError(token, "type mismatch between " + names[(int)_type] + " and " + names[(int)type]);
+	token.PrintError("type mismatch between " + names[(int)_type] + " and " + names[(int)type]);
 	return false;
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 
 enum class DataType
 {
@@ -8,18 +9,26 @@ enum class DataType
 	String,
 	List,
 	Map,
-	Function
+	Function,
+	Deque,
+	Object,
+	Slice,
+	Set,
+	OrderedMap
 };
 
+// row and col are not stored, PrintError works them out from the offset when needed
 struct Token
 {
-	int row;
-	int col;
-	int index;
-	struct SourceCode* sourceCodePtr;
+	unsigned int index;
+	unsigned short sourceId;
 
 	Token();
-	Token(int _row, int _col, int _index, struct SourceCode* _sourceCodePtr);
+	Token(int _index, unsigned short _sourceId);
+
+	struct SourceCode* Source() const;
+
+	void PrintError(const std::string& message) const;
 };
 
 struct Data
@@ -1,8 +1,9 @@
 #include "script.h"
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <chrono>
+#include <memory>
+#include <thread>
+#include <stdlib.h>
 
 class Time
 {
@@ -28,10 +29,33 @@ public:
 	}
 };
 
+static std::string ReadEnvironment(const char* name)
+{
+#ifdef _WIN32
+	char* value = nullptr;
+	size_t size = 0;
+	if (_dupenv_s(&value, &size, name) != 0 || value == nullptr)
+		return "";
+
+	std::string result = value;
+	free(value);
+	return result;
+#else
+	const char* value = getenv(name);
+	return (value == nullptr ? "" : value);
+#endif
+}
 
 int main(int argc, char** argv)
 {
-	if (argc != 2)
+	// 'funky <script-folder>' runs main.funky, 'funky <script-folder> -c <script>' writes <script>c precompiled,
+	// 'funky <script-folder> -w [script]' runs the script (main.funky) once and reloads it whenever it or one of its
+	// includes changes: its top-level defs are swapped into the running script (Script::Reload), which keeps its state,
+	// and its on_reload function is called if it defines one. until a first load succeeds every change loads it anew.
+	// preprocessed scripts are only cached on disk when FUNKY_CACHE_DIR names the directory to keep them in
+	bool compile = (argc == 4 && std::string(argv[2]) == "-c");
+	bool watch = ((argc == 3 || argc == 4) && std::string(argv[2]) == "-w");
+	if (argc != 2 && !compile && !watch)
 	{
 		std::cout << "\n[ERROR] incorrect arguments sent to program, expected path to script-folder" << std::endl;
 		return 1;
@@ -74,16 +98,10 @@ int main(int argc, char** argv)
 		{
 			std::string path = Script::workingDirectory + *dynamic_cast<Value<String>*>(first)->valuePtr;
 			std::string& text = *dynamic_cast<Value<String>*>(second)->valuePtr;
-			std::ifstream file;
-			file.open(path);
-
-			if (file.is_open())
+			MappedFile file;
+			if (file.Open(path))
 			{
-				std::stringstream stringStream;
-				stringStream << file.rdbuf();
-				text = stringStream.str();
-				file.close();
-
+				file.CopyText(text);
 				return;
 			}
 
@@ -106,6 +124,55 @@ int main(int argc, char** argv)
 
 	Script::workingDirectory = argv[1];
 
+	std::string cacheDirectory = ReadEnvironment("FUNKY_CACHE_DIR");
+	if (!cacheDirectory.empty())
+	{
+		Script::cacheDirectory = cacheDirectory;
+		char last = Script::cacheDirectory.back();
+		if (last != '/' && last != '\\')
+			Script::cacheDirectory += '/';
+	}
+
+	if (compile)
+	{
+		Script s;
+		std::string path = argv[3];
+		if (!s.LoadScript(path) || !s.SaveImage(Script::workingDirectory + path + "c"))
+			return 1;
+
+		std::cout << "[INFO] precompiled " << path << " to " << path << "c" << std::endl;
+		return 0;
+	}
+
+	if (watch)
+	{
+		// a reload that fails to load keeps the definitions of the last good one
+		std::string path = (argc == 4 ? argv[3] : "main.funky");
+		std::unique_ptr<Script> script;
+		while (true)
+		{
+			if (script == nullptr || (script->rootFunction == nullptr && script->FilesChanged()))
+			{
+				script.reset(new Script());
+				if (script->LoadScript(path))
+					script->Run();
+
+				std::cout << std::flush;
+				fflush(stdout);
+			}
+			else if (script->rootFunction != nullptr && script->FilesChanged())
+			{
+				if (script->Reload())
+					script->CallDefinition("on_reload");
+
+				std::cout << std::flush;
+				fflush(stdout);
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+
 	Script s;
 	if (s.LoadScript("main.funky"))
 	{
@@ -0,0 +1,198 @@
+#include "lexer.h"
+#include "data.h"
+#include <stdlib.h>
+#include <algorithm>
+
+static bool IsWhitespace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t';
+}
+
+static bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static bool IsWordEnd(char c)
+{
+	return IsWhitespace(c) || c == '(' || c == ')' || c == '"';
+}
+
+int Lexer::AddSymbol(std::vector<Symbol>& table, std::unordered_map<Symbol, int>& ids, Symbol symbol)
+{
+	auto itr = ids.find(symbol);
+	if (itr != ids.end())
+		return itr->second;
+
+	int id = (int)table.size();
+	table.push_back(symbol);
+	ids[symbol] = id;
+	return id;
+}
+
+int Lexer::InternName(const std::string& name)
+{
+	return AddSymbol(names, nameIds, Symbol::Intern(name));
+}
+
+int Lexer::InternString(const char* first, const char* last)
+{
+	// escapes are decoded on the way into the table, so every literal is scanned exactly once
+	std::string str;
+	str.reserve(last - first);
+	for (const char* c = first; c < last; c++)
+	{
+		if (*c == '\\' && c + 1 < last && (c[1] == 'n' || c[1] == 't'))
+			str += (*++c == 'n' ? '\n' : '\t');
+		else
+			str += *c;
+	}
+
+	return AddSymbol(strings, stringIds, Symbol::Intern(str));
+}
+
+bool Lexer::Tokenize(SourceCode& sourceCode)
+{
+	const std::string& text = sourceCode.text;
+	int size = (int)text.size();
+	int i = 0;
+
+	std::vector<int> openParentheses;
+
+	lexemes.clear();
+	lexemes.reserve(size / 4);
+
+	while (i < size)
+	{
+		char c = text[i];
+		Lexeme lexeme;
+		lexeme.index = i;
+		lexeme.id = 0;
+
+		int hiddenStringIndex = 0;
+
+		if (IsWhitespace(c))
+		{
+			i++;
+			continue;
+		}
+		else if (text.compare(i, 2, "/*") == 0)
+		{
+			size_t commentEnd = text.find("*/", i + 2);
+			i = commentEnd == std::string::npos ? size : (int)commentEnd + 2;
+			continue;
+		}
+		else if (text.compare(i, 2, "//") == 0)
+		{
+			size_t lineEnd = text.find('\n', i);
+			i = lineEnd == std::string::npos ? size : (int)lineEnd;
+			continue;
+		}
+		else if (c == '(' || c == ')')
+		{
+			lexeme.type = (c == '(' ? LexemeType::OpeningParenthesis : LexemeType::ClosingParenthesis);
+			if (c == '(')
+				openParentheses.push_back((int)lexemes.size());
+			else if (!openParentheses.empty())
+			{
+				lexemes[openParentheses.back()].id = (int)lexemes.size();
+				openParentheses.pop_back();
+			}
+			i++;
+		}
+		else if (sourceCode.IsHiddenString(i, hiddenStringIndex))
+		{
+			const std::string& str = sourceCode.hiddenStrings[hiddenStringIndex];
+			lexeme.type = LexemeType::String;
+			lexeme.id = InternString(str.data(), str.data() + str.size());
+			i += SourceCode::hiddenStringKeySize;
+		}
+		else if (c == '"')
+		{
+			size_t closingQuote = text.find('"', i + 1);
+			int stringEnd = (closingQuote == std::string::npos ? size : (int)closingQuote);
+			lexeme.type = LexemeType::String;
+			lexeme.id = InternString(text.data() + i + 1, text.data() + stringEnd);
+			i = std::min(stringEnd + 1, size);
+		}
+		else if (c == '-' || IsDigit(c))
+		{
+			bool isFloat = false;
+			int numberEnd = i + 1;
+			for (; numberEnd < size && !IsWordEnd(text[numberEnd]); numberEnd++)
+			{
+				char n = text[numberEnd];
+				if (n == '.' && !isFloat)
+					isFloat = true;
+				else if (!IsDigit(n))
+				{
+					std::string err("unexpected '");
+					err += n;
+					err += "'";
+					sourceCode.PrintError(Token(numberEnd, sourceCode.id), err);
+					return false;
+				}
+			}
+
+			if (numberEnd == i + 1 && c == '-')
+			{
+				sourceCode.PrintError(Token(i, sourceCode.id), "unexpected '-'");
+				return false;
+			}
+
+			if (isFloat)
+			{
+				lexeme.type = LexemeType::Float;
+				lexeme.floatValue = strtof(text.c_str() + i, nullptr);
+			}
+			else
+			{
+				lexeme.type = LexemeType::Int;
+				lexeme.intValue = (int)strtol(text.c_str() + i, nullptr, 10);
+			}
+
+			i = numberEnd;
+		}
+		else
+		{
+			int wordEnd = i + 1;
+			for (; wordEnd < size && !IsWordEnd(text[wordEnd]); wordEnd++);
+
+			std::string word = text.substr(i, wordEnd - i);
+			if (word == "true")
+				lexeme.type = LexemeType::True;
+			else if (word == "false")
+				lexeme.type = LexemeType::False;
+			else if (word == "list")
+				lexeme.type = LexemeType::List;
+			else if (word == "map")
+				lexeme.type = LexemeType::Map;
+			else if (word == "deque")
+				lexeme.type = LexemeType::Deque;
+			else if (word == "set_of")
+				lexeme.type = LexemeType::Set;
+			else if (word == "ordered_map")
+				lexeme.type = LexemeType::OrderedMap;
+			else
+			{
+				lexeme.type = LexemeType::Name;
+				lexeme.id = InternName(word);
+			}
+
+			i = wordEnd;
+		}
+
+		lexemes.push_back(lexeme);
+	}
+
+	Lexeme end;
+	end.type = LexemeType::End;
+	end.index = size;
+	end.id = 0;
+	lexemes.push_back(end);
+
+	for (int opening : openParentheses)
+		lexemes[opening].id = (int)lexemes.size() - 1;
+
+	return true;
+}
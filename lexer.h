@@ -0,0 +1,55 @@
+#pragma once
+#include "source_code.h"
+#include "symbol.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+enum class LexemeType : unsigned char
+{
+	Name,
+	String,
+	Int,
+	Float,
+	True,
+	False,
+	List,
+	Map,
+	Deque,
+	Set,
+	OrderedMap,
+	OpeningParenthesis,
+	ClosingParenthesis,
+	End
+};
+
+struct Lexeme
+{
+	LexemeType type;
+	int index;
+	union
+	{
+		// for '(' the id is the lexeme of the matching ')', or of End when there is none
+		int id;
+		int intValue;
+		float floatValue;
+	};
+};
+
+struct Lexer
+{
+	std::vector<Lexeme> lexemes;
+	// names and string literals are interned, the ids number them within this script
+	std::vector<Symbol> names;
+	std::vector<Symbol> strings;
+	std::unordered_map<Symbol, int> nameIds;
+	std::unordered_map<Symbol, int> stringIds;
+
+	bool Tokenize(SourceCode& sourceCode);
+
+	int InternName(const std::string& name);
+
+	int InternString(const char* first, const char* last);
+
+	static int AddSymbol(std::vector<Symbol>& table, std::unordered_map<Symbol, int>& ids, Symbol symbol);
+};
@@ -0,0 +1,202 @@
+#include "mapped_file.h"
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool FileStamp::operator==(const FileStamp& other) const
+{
+	return modifiedTime == other.modifiedTime && size == other.size;
+}
+
+bool FileStamp::operator!=(const FileStamp& other) const
+{
+	return !(*this == other);
+}
+
+bool GetFileStamp(const std::string& path, FileStamp& outStamp)
+{
+	// times are taken at the finest resolution the platform reports, whole seconds would miss a second edit made
+	// within the same second. a filesystem that keeps coarser times can still hide an edit that keeps the size
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes))
+		return false;
+
+	// 100 nanosecond intervals
+	outStamp.modifiedTime = (long long)(((unsigned long long)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime);
+	outStamp.size = (long long)(((unsigned long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow);
+#else
+	struct stat fileStat;
+	if (stat(path.c_str(), &fileStat) != 0)
+		return false;
+
+#if defined(__APPLE__)
+	outStamp.modifiedTime = (long long)fileStat.st_mtimespec.tv_sec * 1000000000ll + fileStat.st_mtimespec.tv_nsec;
+#else
+	outStamp.modifiedTime = (long long)fileStat.st_mtim.tv_sec * 1000000000ll + fileStat.st_mtim.tv_nsec;
+#endif
+	outStamp.size = (long long)fileStat.st_size;
+#endif
+
+	return true;
+}
+
+MappedFile::MappedFile()
+{
+	data = nullptr;
+	size = 0;
+	isMapped = false;
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = nullptr;
+#else
+	fileDescriptor = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+#ifdef _WIN32
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (GetFileType(fileHandle) != FILE_TYPE_DISK || !GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+		return ReadBuffered();
+
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle == nullptr)
+		return ReadBuffered();
+
+	const void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+		return ReadBuffered();
+
+	size = (size_t)fileSize.QuadPart;
+#else
+	fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || fileStat.st_size == 0)
+		return ReadBuffered();
+
+	void* view = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (view == MAP_FAILED)
+		return ReadBuffered();
+
+	size = (size_t)fileStat.st_size;
+#endif
+
+	data = (const char*)view;
+	isMapped = true;
+	return true;
+}
+
+bool MappedFile::ReadBuffered()
+{
+	char chunk[65536];
+
+	while (true)
+	{
+#ifdef _WIN32
+		DWORD bytesRead = 0;
+		if (!ReadFile(fileHandle, chunk, sizeof(chunk), &bytesRead, nullptr))
+		{
+			// a pipe whose writer went away reports its end as an error
+			if (GetLastError() == ERROR_BROKEN_PIPE)
+				break;
+
+			Close();
+			return false;
+		}
+#else
+		ssize_t bytesRead = read(fileDescriptor, chunk, sizeof(chunk));
+		if (bytesRead < 0)
+		{
+			Close();
+			return false;
+		}
+#endif
+
+		if (bytesRead == 0)
+			break;
+
+		buffer.append(chunk, (size_t)bytesRead);
+	}
+
+	data = buffer.data();
+	size = buffer.size();
+	return true;
+}
+
+void MappedFile::CopyText(std::string& outText) const
+{
+#ifdef _WIN32
+	// the text comes out the way a text mode stream reads it on windows: \r\n becomes \n and ctrl-z ends the file.
+	// elsewhere text mode changes nothing, so the bytes are copied as they are
+	const char* endOfFile = (const char*)memchr(data, 0x1A, size);
+	const char* last = (endOfFile == nullptr ? data + size : endOfFile);
+	const char* carriageReturn = (const char*)memchr(data, '\r', last - data);
+	if (carriageReturn == nullptr)
+	{
+		outText.assign(data, last);
+		return;
+	}
+
+	outText.reserve(last - data);
+	outText.assign(data, carriageReturn);
+	for (const char* c = carriageReturn; c < last; c++)
+		if (*c != '\r' || c + 1 == last || c[1] != '\n')
+			outText += *c;
+#else
+	outText.assign(data, size);
+#endif
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (isMapped)
+		UnmapViewOfFile(data);
+
+	if (mappingHandle != nullptr)
+		CloseHandle(mappingHandle);
+
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = nullptr;
+#else
+	if (isMapped)
+		munmap((void*)data, size);
+
+	if (fileDescriptor >= 0)
+		close(fileDescriptor);
+
+	fileDescriptor = -1;
+#endif
+
+	buffer.clear();
+	buffer.shrink_to_fit();
+	isMapped = false;
+	data = nullptr;
+	size = 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+
+// modification time and size of a file, used to tell whether it changed since it was last read
+struct FileStamp
+{
+	long long modifiedTime;
+	long long size;
+
+	bool operator==(const FileStamp& other) const;
+
+	bool operator!=(const FileStamp& other) const;
+};
+
+bool GetFileStamp(const std::string& path, FileStamp& outStamp);
+
+// read-only view of a whole file, mapped into memory instead of copied.
+// pipes, empty or special files and failed mappings are read into buffer instead
+struct MappedFile
+{
+	const char* data;
+	size_t size;
+	bool isMapped;
+	std::string buffer;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+
+	MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool Open(const std::string& path);
+
+	bool ReadBuffered();
+
+	void CopyText(std::string& outText) const;
+
+	void Close();
+};
@@ -3,48 +3,42 @@
 #include <stdlib.h>
 #include <new>
 #include <type_traits>
+#include <vector>
 
+// objects are placed in blocks of SIZE slots, another block is added when every slot is taken
 template<typename T, size_t SIZE>
 class MemoryPool
 {
 private:
-	T* pool;
-	bool* available;
-	size_t bestGuess;
+	std::vector<T*> blocks;
+	std::vector<T*> freeSlots;
 
 	T* FindAvailable()
 	{
-		for (size_t i = 0; i < SIZE; i++)
+		if (freeSlots.empty())
 		{
-			size_t j = (i + bestGuess) % SIZE;
-			if (available[j])
-			{
-				available[j] = false;
-				bestGuess = j + 1;
-				return (pool + j);
-			}
+			T* block = (T*)malloc(sizeof(T) * SIZE);
+			assert(block != nullptr);
+			blocks.push_back(block);
+
+			// pushed back to front so the slots of a block are handed out in order
+			freeSlots.reserve(freeSlots.size() + SIZE);
+			for (size_t i = SIZE; i > 0; i--)
+				freeSlots.push_back(block + i - 1);
 		}
 
-		assert(false);
-		return nullptr;
+		T* slot = freeSlots.back();
+		freeSlots.pop_back();
+		return slot;
 	}
 
 public:
-	MemoryPool()
-	{
-		pool = (T*)malloc(sizeof(T) * SIZE);
-		available = (bool*)malloc(sizeof(bool) * SIZE);
-
-		for (size_t i = 0; i < SIZE; i++)
-			available[i] = true;
-
-		bestGuess = 0;
-	}
+	MemoryPool() {}
 
 	~MemoryPool()
 	{
-		free(pool);
-		free(available);
+		for (auto& block : blocks)
+			free(block);
 	}
 
 	template<typename... ARGS>
@@ -58,16 +52,7 @@ public:
 		if (std::is_destructible<T>::value)
 			ptr->~T();
 
-		size_t poolAdress = reinterpret_cast<size_t>(pool);
-		size_t ptrAdress = reinterpret_cast<size_t>(ptr);
-
-		assert((ptrAdress >= poolAdress));
-
-		size_t index = (ptrAdress - poolAdress) / sizeof(T);
-
-		assert((index < SIZE));
-
-		available[index] = true;
+		freeSlots.push_back(ptr);
 	}
 };
 
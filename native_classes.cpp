@@ -0,0 +1,228 @@
+#include "native_classes.h"
+#include "script.h"
+
+static const int firstArgument = 2;
+
+static bool GetArgument(Function* self, int i, Data*& outArg)
+{
+	if (firstArgument + i >= self->arguments.size())
+	{
+		self->arguments[1]->token.PrintError("too few arguments sent to method");
+		return false;
+	}
+
+	outArg = self->arguments[firstArgument + i]->Evaluate();
+	return outArg != nullptr;
+}
+
+static void Deque_Push(Function* self, Object& object)
+{
+	Deque& items = *dynamic_cast<Value<Deque>*>(object.state)->valuePtr;
+	for (int i = firstArgument; i < self->arguments.size(); i++)
+	{
+		Data* val = self->arguments[i]->Evaluate();
+		if (val == nullptr)
+			return;
+
+		Data* copy = nullptr;
+		val->CreateSameType(copy);
+		copy->CopyOther(val);
+		items.push_back(copy);
+	}
+}
+
+static void Deque_Count(Function* self, Object& object)
+{
+	Value<Int>* count = Memory<Value<Int>>().New(DataType::Int, false, self->arguments[1]->token);
+	count->SetValue(dynamic_cast<Value<Deque>*>(object.state)->valuePtr->size());
+	self->returnValue = count;
+}
+
+static void Stack_Pop(Function* self, Object& object)
+{
+	Deque& items = *dynamic_cast<Value<Deque>*>(object.state)->valuePtr;
+	if (items.size() == 0)
+	{
+		self->arguments[1]->token.PrintError("stack is empty");
+		return;
+	}
+
+	self->returnValue = items.pop_back();
+}
+
+static void Queue_Pop(Function* self, Object& object)
+{
+	Deque& items = *dynamic_cast<Value<Deque>*>(object.state)->valuePtr;
+	if (items.size() == 0)
+	{
+		self->arguments[1]->token.PrintError("queue is empty");
+		return;
+	}
+
+	self->returnValue = items.pop_front();
+}
+
+// TMap takes keys of any printable type and stores them as strings
+static bool GetKey(Function* self, std::string& outKey)
+{
+	Data* key = nullptr;
+	return GetArgument(self, 0, key) && FunctionLibrary::Helper_ToString(key, outKey);
+}
+
+static void TMap_Set(Function* self, Object& object)
+{
+	std::string key;
+	Data* val = nullptr;
+	if (!GetKey(self, key) || !GetArgument(self, 1, val))
+		return;
+
+	// like push_copy on a map an existing key keeps its value
+	Map& map = *dynamic_cast<Value<Map>*>(object.state)->valuePtr;
+	if (map.count(key) != 0)
+		return;
+
+	Data* copy = nullptr;
+	val->CreateSameType(copy);
+	copy->CopyOther(val);
+	map.insert({ key, copy });
+}
+
+static void TMap_Get(Function* self, Object& object)
+{
+	std::string key;
+	if (!GetKey(self, key))
+		return;
+
+	Map& map = *dynamic_cast<Value<Map>*>(object.state)->valuePtr;
+	if (map.count(key) == 0)
+	{
+		self->arguments[firstArgument]->token.PrintError("key not found");
+		return;
+	}
+
+	Data* item = map.at(key);
+	item->CreateSameType(self->returnValue);
+	self->returnValue->ReferenceOther(item);
+}
+
+static void TMap_Remove(Function* self, Object& object)
+{
+	std::string key;
+	if (!GetKey(self, key))
+		return;
+
+	Map& map = *dynamic_cast<Value<Map>*>(object.state)->valuePtr;
+	if (map.count(key) == 0)
+	{
+		self->arguments[firstArgument]->token.PrintError("key not found");
+		return;
+	}
+
+	FreeData(map.at(key));
+	map.erase(key);
+}
+
+static void TMap_Contains(Function* self, Object& object)
+{
+	std::string key;
+	if (!GetKey(self, key))
+		return;
+
+	Value<Bool>* contains = Memory<Value<Bool>>().New(DataType::Bool, false, self->arguments[1]->token);
+	contains->SetValue(dynamic_cast<Value<Map>*>(object.state)->valuePtr->count(key) != 0);
+	self->returnValue = contains;
+}
+
+static void TMap_Keys(Function* self, Object& object)
+{
+	const Token& token = self->arguments[1]->token;
+	Value<List>* list = Memory<Value<List>>().New(DataType::List, false, token);
+	list->Init();
+
+	for (auto& e : *dynamic_cast<Value<Map>*>(object.state)->valuePtr)
+	{
+		Value<String>* key = Memory<Value<String>>().New(DataType::String, false, token);
+		key->SetValue(e.key);
+		list->valuePtr->push_back(key);
+	}
+
+	self->returnValue = list;
+}
+
+// StringBuilder appends to one string that grows in place, for building large outputs piece by piece
+static void StringBuilder_Append(Function* self, Object& object)
+{
+	String& text = *dynamic_cast<Value<String>*>(object.state)->valuePtr;
+	std::string str;
+	for (int i = firstArgument; i < self->arguments.size(); i++)
+	{
+		Data* val = self->arguments[i]->Evaluate();
+		if (val == nullptr)
+			return;
+
+		if (val->type == DataType::String)
+		{
+			text.append(*dynamic_cast<Value<String>*>(val)->valuePtr);
+			continue;
+		}
+
+		if (!FunctionLibrary::Helper_ToString(val, str))
+			return;
+
+		text.append(str);
+	}
+}
+
+static void StringBuilder_ToString(Function* self, Object& object)
+{
+	Value<String>* str = Memory<Value<String>>().New(DataType::String, false, self->arguments[1]->token);
+	str->SetValue(*dynamic_cast<Value<String>*>(object.state)->valuePtr);
+	self->returnValue = str;
+}
+
+static void StringBuilder_Count(Function* self, Object& object)
+{
+	Value<Int>* count = Memory<Value<Int>>().New(DataType::Int, false, self->arguments[1]->token);
+	count->SetValue((int)dynamic_cast<Value<String>*>(object.state)->valuePtr->size());
+	self->returnValue = count;
+}
+
+static void StringBuilder_Clear(Function*, Object& object)
+{
+	dynamic_cast<Value<String>*>(object.state)->valuePtr->clear();
+}
+
+Data* NativeClass::NewState(const Token& token) const
+{
+	if (stateType == DataType::String)
+	{
+		Value<String>* state = Memory<Value<String>>().New(DataType::String, false, token);
+		state->Init();
+		return state;
+	}
+
+	if (stateType == DataType::Deque)
+	{
+		Value<Deque>* state = Memory<Value<Deque>>().New(DataType::Deque, false, token);
+		state->Init();
+		return state;
+	}
+
+	Value<Map>* state = Memory<Value<Map>>().New(DataType::Map, false, token);
+	state->Init();
+	return state;
+}
+
+const NativeClass* NativeClass::Find(const std::string& name)
+{
+	static const std::unordered_map<std::string, NativeClass> classes =
+	{
+		{"Stack", {"Stack", DataType::Deque, {{"Push", Deque_Push}, {"Pop", Stack_Pop}, {"Count", Deque_Count}}}},
+		{"Queue", {"Queue", DataType::Deque, {{"Push", Deque_Push}, {"Pop", Queue_Pop}, {"Count", Deque_Count}}}},
+		{"TMap", {"TMap", DataType::Map, {{"Set", TMap_Set}, {"Get", TMap_Get}, {"Remove", TMap_Remove}, {"Contains", TMap_Contains}, {"Keys", TMap_Keys}}}},
+		{"StringBuilder", {"StringBuilder", DataType::String, {{"Append", StringBuilder_Append}, {"ToString", StringBuilder_ToString}, {"Count", StringBuilder_Count}, {"Clear", StringBuilder_Clear}}}}
+	};
+
+	auto itr = classes.find(name);
+	return itr == classes.end() ? nullptr : &itr->second;
+}
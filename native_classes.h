@@ -0,0 +1,18 @@
+#pragma once
+#include "value.h"
+#include "value_types.h"
+#include <string>
+#include <unordered_map>
+
+// a class written in c++, its objects keep their data in a single value of stateType.
+// methods are run by call_member(object "name" args...) and read their arguments from self->arguments[2] on
+struct NativeClass
+{
+	std::string name;
+	DataType stateType;
+	std::unordered_map<std::string, void(*)(Function* self, Object& object)> methods;
+
+	Data* NewState(const Token& token) const;
+
+	static const NativeClass* Find(const std::string& name);
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// below this many items a plain std::stable_sort is faster than starting threads
+static const size_t parallelSortThreshold = 1 << 16;
+
+// stable sort that splits large inputs into one run per hardware thread, sorts the runs in parallel and then
+// merges neighbouring runs pairwise, also in parallel, until one run is left. less must be safe to call from
+// several threads at once, so it can not call back into a script.
+template<typename T, typename Less>
+void ParallelStableSort(std::vector<T>& items, Less less)
+{
+	size_t runCount = std::thread::hardware_concurrency();
+	if (items.size() < parallelSortThreshold || runCount < 2)
+	{
+		std::stable_sort(items.begin(), items.end(), less);
+		return;
+	}
+
+	std::vector<size_t> bounds;
+	for (size_t i = 0; i <= runCount; i++)
+		bounds.push_back(items.size() * i / runCount);
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < runCount; i++)
+	{
+		size_t first = bounds[i], last = bounds[i + 1];
+		threads.emplace_back([&items, &less, first, last]()
+		{
+			std::stable_sort(items.begin() + first, items.begin() + last, less);
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	std::vector<T> buffer(items.size());
+	std::vector<T>* from = &items;
+	std::vector<T>* to = &buffer;
+	while (bounds.size() > 2)
+	{
+		std::vector<size_t> merged;
+		threads.clear();
+		for (size_t i = 0; i + 1 < bounds.size(); i += 2)
+		{
+			merged.push_back(bounds[i]);
+			size_t first = bounds[i], middle = bounds[i + 1];
+			if (i + 2 >= bounds.size())
+			{
+				// an odd run out is carried over to the next round as it is
+				std::copy(from->begin() + first, from->begin() + middle, to->begin() + first);
+				continue;
+			}
+
+			size_t last = bounds[i + 2];
+			threads.emplace_back([from, to, &less, first, middle, last]()
+			{
+				// on ties std::merge takes from the first run, which keeps the sort stable
+				std::merge(from->begin() + first, from->begin() + middle, from->begin() + middle, from->begin() + last, to->begin() + first, less);
+			});
+		}
+		merged.push_back(bounds.back());
+
+		for (auto& thread : threads)
+			thread.join();
+
+		std::swap(from, to);
+		bounds = merged;
+	}
+
+	if (from != &items)
+		items.swap(buffer);
+}
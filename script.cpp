@@ -1,8 +1,12 @@
 #include "script.h"
+#include "parallel_sort.h"
 #include <iostream>
 #include <regex>
+#include <thread>
+#include <atomic>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 
 #define AFFIRM_DATA(data) if(data == nullptr){return;}
 
@@ -23,6 +27,8 @@ FunctionLibrary::FunctionLibrary()
 		{"get_elem", F_GetElement},
 		{"rem_elem", F_RemoveElement},
 		{"has_key", F_HasKey},
+		{"pop_front", F_PopFront},
+		{"pop_back", F_PopBack},
 		{"def", F_DefineFunction},
 		{"get", F_GetVariable},
 		{"ref_func", F_GetFunctionReference},
@@ -45,6 +51,33 @@ FunctionLibrary::FunctionLibrary()
 		{"equal", F_Equal},
 		{"count", F_Count},
 		{"keys", F_Keys},
+		{"slice", F_Slice},
+		{"sort", F_Sort},
+		{"sort_by", F_SortBy},
+		{"insert", F_Insert},
+		{"contains", F_Contains},
+		{"remove", F_Remove},
+		{"union", F_Union},
+		{"intersect", F_Intersect},
+		{"difference", F_Difference},
+		{"lower_bound", F_LowerBound},
+		{"upper_bound", F_UpperBound},
+		{"key_at", F_KeyAt},
+		{"value_at", F_ValueAt},
+		{"min_key", F_MinKey},
+		{"max_key", F_MaxKey},
+		{"sum", F_Sum},
+		{"min", F_Min},
+		{"max", F_Max},
+		{"dot", F_Dot},
+		{"vadd", F_VAdd},
+		{"vsub", F_VSub},
+		{"vmul", F_VMul},
+		{"vscale", F_VScale},
+		{"fill", F_Fill},
+		{"range", F_Range},
+		{"new_object", F_NewObject},
+		{"call_member", F_CallMember},
 		{"call_cpp", F_CallCPPFunction}
 	};
 }
@@ -106,7 +139,15 @@ void FunctionLibrary::Helper_PrintList(Data* data)
 		if (i > 0)
 			std::cout << ", ";
 
-		Helper_PrintAny(l[i]);
+		// packed values are printed straight from their array, printing must not box them
+		if (l.packedType == DataType::Int)
+			std::cout << l.ints[i];
+		else if (l.packedType == DataType::Float)
+			std::cout << l.floats[i];
+		else if (l.packedType == DataType::Bool)
+			std::cout << std::boolalpha << (l.bools[i] != 0);
+		else
+			Helper_PrintAny(l[i]);
 	}
 	std::cout << "]";
 }
@@ -116,24 +157,119 @@ void FunctionLibrary::Helper_PrintMap(Data* data)
 	Map& m = *dynamic_cast<Value<Map>*>(data)->valuePtr;
 	std::cout << "[";
 	int i = 0;
-	for (auto& e : m.map)
+	for (auto& e : m)
 	{
 		if (i > 0)
 			std::cout << ", ";
 
-		std::cout << "{" << e.first << ": ";
-		Helper_PrintAny(e.second);
+		std::cout << "{" << e.key << ": ";
+		Helper_PrintAny(e.value);
 		std::cout << "}";
 		i++;
 	}
 	std::cout << "]";
 }
 
+void FunctionLibrary::Helper_PrintDeque(Data* data)
+{
+	Deque& d = *dynamic_cast<Value<Deque>*>(data)->valuePtr;
+	std::cout << "[";
+	for (int i = 0; i < d.size(); i++)
+	{
+		if (i > 0)
+			std::cout << ", ";
+
+		Helper_PrintAny(d.items[i]);
+	}
+	std::cout << "]";
+}
+
+void FunctionLibrary::Helper_PrintSet(Data* data)
+{
+	Set& s = *dynamic_cast<Value<Set>*>(data)->valuePtr;
+	std::cout << "{";
+	for (int i = 0; i < s.size(); i++)
+	{
+		if (i > 0)
+			std::cout << ", ";
+
+		if (s.items[i].isInt)
+			std::cout << s.items[i].number;
+		else
+			std::cout << s.items[i].text;
+	}
+	std::cout << "}";
+}
+
+void FunctionLibrary::Helper_PrintOrderedMap(Data* data)
+{
+	OrderedMap& m = *dynamic_cast<Value<OrderedMap>*>(data)->valuePtr;
+	std::cout << "[";
+	int i = 0;
+	for (OrderedMapNode* leaf = m.FirstLeaf(); leaf != nullptr; leaf = leaf->next)
+	{
+		for (int j = 0; j < (int)leaf->keys.size(); j++)
+		{
+			if (i > 0)
+				std::cout << ", ";
+
+			std::cout << "{";
+			if (leaf->keys[j].isInt)
+				std::cout << leaf->keys[j].number;
+			else
+				std::cout << leaf->keys[j].text;
+			std::cout << ": ";
+			Helper_PrintAny(leaf->values[j]);
+			std::cout << "}";
+			i++;
+		}
+	}
+	std::cout << "]";
+}
+
 void FunctionLibrary::Helper_PrintFunction(Data* data)
 {
 	std::cout << "function()";
 }
 
+void FunctionLibrary::Helper_PrintObject(Data* data)
+{
+	// a string builder prints as its text
+	Object& object = *dynamic_cast<Value<Object>*>(data)->valuePtr;
+	if (object.state->type != DataType::String)
+		std::cout << object.nativeClass->name;
+
+	Helper_PrintAny(object.state);
+}
+
+void FunctionLibrary::Helper_PrintSlice(Data* data)
+{
+	Slice& slice = *dynamic_cast<Value<Slice>*>(data)->valuePtr;
+	if (slice.source->type == DataType::String)
+	{
+		std::cout.write(dynamic_cast<Value<String>*>(slice.source)->valuePtr->data() + slice.start, slice.size());
+		return;
+	}
+
+	List& l = *dynamic_cast<Value<List>*>(slice.source)->valuePtr;
+	std::cout << "[";
+	for (int i = slice.start; i < slice.start + slice.size(); i++)
+	{
+		if (i > slice.start)
+			std::cout << ", ";
+
+		if (l.packedType == DataType::Int)
+			std::cout << l.ints[i];
+		else if (l.packedType == DataType::Float)
+			std::cout << l.floats[i];
+		else if (l.packedType == DataType::Bool)
+			std::cout << std::boolalpha << (l.bools[i] != 0);
+		else
+			Helper_PrintAny(l.list[i]);
+	}
+	std::cout << "]";
+}
+
 void FunctionLibrary::Helper_PrintAny(Data* d)
 {
 	static void(*printFunctions[])(Data*) {
@@ -143,7 +279,12 @@ void FunctionLibrary::Helper_PrintAny(Data* d)
 			Helper_PrintString,
 			Helper_PrintList,
 			Helper_PrintMap,
-			Helper_PrintFunction
+			Helper_PrintFunction,
+			Helper_PrintDeque,
+			Helper_PrintObject,
+			Helper_PrintSlice,
+			Helper_PrintSet,
+			Helper_PrintOrderedMap
 	};
 
 	printFunctions[(int)d->type](d);
@@ -153,7 +294,7 @@ void FunctionLibrary::F_Print(Function* self)
 {
 	for (auto& arg : self->arguments)
 	{
-		Data* res = arg->Evaluate();
+		Data* res = Helper_ReadValue(arg);
 		AFFIRM_DATA(res)
 
 			Helper_PrintAny(res);
@@ -189,7 +330,7 @@ void FunctionLibrary::F_Input(Function* self)
 			}
 			else
 			{
-				data->token.sourceCodePtr->PrintError(data->token, "expected bool, int, float or string");
+				data->token.PrintError("expected bool, int, float or string");
 			}
 	}
 }
@@ -199,7 +340,7 @@ void FunctionLibrary::F_ReturnCopy(Function* self)
 	if (!self->CheckArgumens(1))
 		return;
 
-	Data* ret = self->arguments[0]->Evaluate();
+	Data* ret = Helper_ReadValue(self->arguments[0]);
 	AFFIRM_DATA(ret)
 
 		ret->CreateSameType(self->parent->returnValue);
@@ -218,6 +359,86 @@ void FunctionLibrary::F_ReturnReference(Function* self)
 	self->parent->returnValue->ReferenceOther(ret);
 }
 
+VariableName FunctionLibrary::Helper_GetName(Function* self, Value<String>* name)
+{
+	// a literal name was interned by the lexer, its symbol is looked up once and kept on the call.
+	// names made at run time are looked up on every call and never interned
+	if (name->isConst && name == self->arguments[0])
+	{
+		if (self->nameSymbol.IsNull())
+			self->nameSymbol = Symbol::Find(*name->valuePtr);
+
+		if (!self->nameSymbol.IsNull())
+			return VariableName(self->nameSymbol);
+	}
+
+	return VariableName(*name->valuePtr);
+}
+
+bool FunctionLibrary::Helper_AppendInPlace(Function* self, const VariableName& name)
+{
+	// set_copy("s" add(get("s") x)), which is what s += x expands to, appends x to the string s
+	// instead of building a new string. nested adds like add(add(get("s") x) y) append x and then y
+	std::vector<Data*> parts;
+	Data* node = self->arguments[1];
+	while (true)
+	{
+		if (node->type != DataType::Function)
+			return false;
+
+		Function* call = dynamic_cast<Value<Function>*>(node)->valuePtr;
+		if (call->function == F_GetVariable && !parts.empty() && call->arguments.size() == 1)
+		{
+			Data* varName = call->arguments[0];
+			if (varName->type != DataType::String || *dynamic_cast<Value<String>*>(varName)->valuePtr != name.Text())
+				return false;
+
+			break;
+		}
+
+		if (call->function != F_Add || call->arguments.size() != 2)
+			return false;
+
+		parts.push_back(call->arguments[1]);
+		node = call->arguments[0];
+	}
+
+	Data* current = nullptr;
+	if (!self->GetVariable(name, current) || current->type != DataType::String || current->isConst)
+		return false;
+
+	// everything is evaluated before the string changes, like add does
+	std::vector<Value<String>*> values;
+	for (int i = (int)parts.size() - 1; i >= 0; i--)
+	{
+		Data* val = parts[i]->Evaluate();
+		if (val == nullptr)
+			return true;
+
+		if (val->type != DataType::String)
+		{
+			val->token.PrintError("type mismatch");
+			return true;
+		}
+
+		values.push_back(dynamic_cast<Value<String>*>(val));
+	}
+
+	// a part may be s itself (s += .s), it stands for the value s had before appending
+	Slice::DetachViews(current);
+	String& target = *dynamic_cast<Value<String>*>(current)->valuePtr;
+	size_t originalSize = target.size();
+	for (auto& val : values)
+	{
+		if (val->valuePtr == &target)
+			target.append(target, 0, originalSize);
+		else
+			target.append(*val->valuePtr);
+	}
+
+	return true;
+}
+
 void FunctionLibrary::F_SetCopy(Function* self)
 {
 	if (!self->CheckArgumens(2))
@@ -228,25 +449,29 @@ void FunctionLibrary::F_SetCopy(Function* self)
 
 		if (first->type != DataType::String)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected variable name (string)");
+			first->token.PrintError("expected variable name (string)");
 			return;
 		}
 
-	Value<String>* name = dynamic_cast<Value<String>*>(first);
-	Data* data = self->arguments[1]->Evaluate();
+	VariableName name = Helper_GetName(self, dynamic_cast<Value<String>*>(first));
+	if (Helper_AppendInPlace(self, name))
+		return;
+
+	Data* data = Helper_ReadValue(self->arguments[1]);
 	AFFIRM_DATA(data)
 
 		Data* current = nullptr;
 
-	if (self->GetVariable(*name->valuePtr, current))
+	if (self->GetVariable(name, current))
 	{
+		Slice::DetachViews(current);
 		current->CopyOther(data);
 	}
 	else
 	{
 		data->CreateSameType(current);
 		current->CopyOther(data);
-		self->parent->AddVariable(*name->valuePtr, current);
+		self->parent->AddVariable(name, current);
 	}
 }
 
@@ -260,17 +485,17 @@ void FunctionLibrary::F_SetReference(Function* self)
 
 		if (first->type != DataType::String)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected variable name (string)");
+			first->token.PrintError("expected variable name (string)");
 			return;
 		}
 
-	Value<String>* name = dynamic_cast<Value<String>*>(first);
+	VariableName name = Helper_GetName(self, dynamic_cast<Value<String>*>(first));
 	Data* data = self->arguments[1]->Evaluate();
 	AFFIRM_DATA(data)
 
 		Data* current = nullptr;
 
-	if (self->GetVariable(*name->valuePtr, current))
+	if (self->GetVariable(name, current))
 	{
 		current->ReferenceOther(data);
 	}
@@ -278,7 +503,7 @@ void FunctionLibrary::F_SetReference(Function* self)
 	{
 		data->CreateSameType(current);
 		current->ReferenceOther(data);
-		self->parent->AddVariable(*name->valuePtr, current);
+		self->parent->AddVariable(name, current);
 	}
 }
 
@@ -289,15 +514,17 @@ void FunctionLibrary::F_AddElementsAsCopies(Function* self)
 
 	Data* first = self->arguments[0]->Evaluate();
 	AFFIRM_DATA(first)
+		first = Helper_PrepareChange(first);
 
-		if (first->type != DataType::List && first->type != DataType::Map)
+
+		if (first->type != DataType::List && first->type != DataType::Map && first->type != DataType::Deque && first->type != DataType::OrderedMap)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected list or map");
+			first->token.PrintError("expected list, map, ordered_map or deque");
 			return;
 		}
 	if (first->isConst)
 	{
-		first->token.sourceCodePtr->PrintError(first->token, "tried to change const container");
+		first->token.PrintError("tried to change const container");
 		return;
 	}
 
@@ -307,31 +534,52 @@ void FunctionLibrary::F_AddElementsAsCopies(Function* self)
 		for (int i = 1; i < self->arguments.size(); i++)
 		{
 			Data* copy = nullptr;
-			Data* val = self->arguments[i]->Evaluate();
+			Data* val = Helper_ReadValue(self->arguments[i]);
 			AFFIRM_DATA(val)
 
-				val->CreateSameType(copy);
+				if (list->valuePtr->PushPacked(val))
+					continue;
+
+			val->CreateSameType(copy);
 			copy->CopyOther(val);
 			list->valuePtr->push_back(copy);
 		}
 	}
+	else if (first->type == DataType::Deque)
+	{
+		Value<Deque>* deque = dynamic_cast<Value<Deque>*>(first);
+		for (int i = 1; i < self->arguments.size(); i++)
+		{
+			Data* copy = nullptr;
+			Data* val = Helper_ReadValue(self->arguments[i]);
+			AFFIRM_DATA(val)
+
+				val->CreateSameType(copy);
+			copy->CopyOther(val);
+			deque->valuePtr->push_back(copy);
+		}
+	}
+	else if (first->type == DataType::OrderedMap)
+	{
+		Helper_AddOrderedMapEntries(self, dynamic_cast<Value<OrderedMap>*>(first), true);
+	}
 	else
 	{
 		Value<Map>* map = dynamic_cast<Value<Map>*>(first);
 		for (int i = 1; i + 1 < self->arguments.size(); i += 2)
 		{
 			Data* copy = nullptr;
-			Data* key = self->arguments[i]->Evaluate();
+			Data* key = Helper_ReadValue(self->arguments[i]);
 			AFFIRM_DATA(key)
 
 				if (key->type != DataType::String)
 				{
-					key->token.sourceCodePtr->PrintError(key->token, "expected string as key");
+					key->token.PrintError("expected string as key");
 					return;
 				}
 
 			Value<String>* keyStr = dynamic_cast<Value<String>*>(key);
-			Data* val = self->arguments[i + 1]->Evaluate();
+			Data* val = Helper_ReadValue(self->arguments[i + 1]);
 			AFFIRM_DATA(val)
 
 				val->CreateSameType(copy);
@@ -348,15 +596,17 @@ void FunctionLibrary::F_AddElementsAsReferences(Function* self)
 
 	Data* first = self->arguments[0]->Evaluate();
 	AFFIRM_DATA(first)
+		first = Helper_PrepareChange(first);
 
-		if (first->type != DataType::List && first->type != DataType::Map)
+
+		if (first->type != DataType::List && first->type != DataType::Map && first->type != DataType::Deque && first->type != DataType::OrderedMap)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected list or map");
+			first->token.PrintError("expected list, map, ordered_map or deque");
 			return;
 		}
 	if (first->isConst)
 	{
-		first->token.sourceCodePtr->PrintError(first->token, "tried to change const container");
+		first->token.PrintError("tried to change const container");
 		return;
 	}
 
@@ -374,6 +624,24 @@ void FunctionLibrary::F_AddElementsAsReferences(Function* self)
 			list->valuePtr->push_back(copy);
 		}
 	}
+	else if (first->type == DataType::Deque)
+	{
+		Value<Deque>* deque = dynamic_cast<Value<Deque>*>(first);
+		for (int i = 1; i < self->arguments.size(); i++)
+		{
+			Data* copy = nullptr;
+			Data* val = self->arguments[i]->Evaluate();
+			AFFIRM_DATA(val)
+
+				val->CreateSameType(copy);
+			copy->ReferenceOther(val);
+			deque->valuePtr->push_back(copy);
+		}
+	}
+	else if (first->type == DataType::OrderedMap)
+	{
+		Helper_AddOrderedMapEntries(self, dynamic_cast<Value<OrderedMap>*>(first), false);
+	}
 	else
 	{
 		Value<Map>* map = dynamic_cast<Value<Map>*>(first);
@@ -385,7 +653,7 @@ void FunctionLibrary::F_AddElementsAsReferences(Function* self)
 
 				if (key->type != DataType::String)
 				{
-					key->token.sourceCodePtr->PrintError(key->token, "expected string as key");
+					key->token.PrintError("expected string as key");
 					return;
 				}
 
@@ -407,6 +675,30 @@ void FunctionLibrary::F_AddElementsAsReferences(Function* self)
 }
 
 void FunctionLibrary::F_GetElement(Function* self)
+{
+	Helper_GetElement(self, true);
+}
+
+Data* FunctionLibrary::Helper_ReadValue(Data* arg)
+{
+	// get_elem hands out its element by reference, which boxes a packed list. a caller that only reads the value
+	// takes a packed element as a new value instead, so reading a packed list keeps it packed
+	if (arg->type == DataType::Function)
+	{
+		Function* call = dynamic_cast<Value<Function>*>(arg)->valuePtr;
+		if (call->function == F_GetElement)
+		{
+			FreeData(call->returnValue);
+			call->returnValue = nullptr;
+			Helper_GetElement(call, false);
+			return call->returnValue;
+		}
+	}
+
+	return arg->Evaluate();
+}
+
+void FunctionLibrary::Helper_GetElement(Function* self, bool reference)
 {
 	if (!self->CheckArgumens(2))
 		return;
@@ -414,7 +706,7 @@ void FunctionLibrary::F_GetElement(Function* self)
 	Data* first = self->arguments[0]->Evaluate();
 	AFFIRM_DATA(first)
 
-		Data* second = self->arguments[1]->Evaluate();
+		Data* second = Helper_ReadValue(self->arguments[1]);
 	AFFIRM_DATA(second)
 
 		if (first->type == DataType::List)
@@ -433,14 +725,45 @@ void FunctionLibrary::F_GetElement(Function* self)
 
 			if (i < 0 || i >= list->valuePtr->size())
 			{
-				second->token.sourceCodePtr->PrintError(second->token, "index out of range");
+				second->token.PrintError("index out of range");
+				return;
+			}
+
+			if (!reference && list->valuePtr->IsPacked())
+			{
+				self->returnValue = list->valuePtr->BoxElement(i);
 				return;
 			}
 
+			// the element is handed out by reference, so a packed list is boxed here
 			Data* item = list->valuePtr->at(i);
 			item->CreateSameType(self->returnValue);
 			self->returnValue->ReferenceOther(item);
 		}
+		else if (first->type == DataType::Deque)
+		{
+			if (!second->AffirmSameType(DataType::Int))
+				return;
+
+			Value<Deque>* deque = dynamic_cast<Value<Deque>*>(first);
+			Value<Int>* index = dynamic_cast<Value<Int>*>(second);
+
+			int i = 0;
+			if (*index->valuePtr == -1)
+				i = deque->valuePtr->size() - 1;
+			else
+				i = *index->valuePtr;
+
+			if (i < 0 || i >= deque->valuePtr->size())
+			{
+				second->token.PrintError("index out of range");
+				return;
+			}
+
+			Data* item = deque->valuePtr->at(i);
+			item->CreateSameType(self->returnValue);
+			self->returnValue->ReferenceOther(item);
+		}
 		else if (first->type == DataType::Map)
 		{
 			if (!second->AffirmSameType(DataType::String))
@@ -453,7 +776,7 @@ void FunctionLibrary::F_GetElement(Function* self)
 
 			if (map->valuePtr->count(k) == 0)
 			{
-				second->token.sourceCodePtr->PrintError(second->token, "key not found");
+				second->token.PrintError("key not found");
 				return;
 			}
 
@@ -461,6 +784,81 @@ void FunctionLibrary::F_GetElement(Function* self)
 			item->CreateSameType(self->returnValue);
 			self->returnValue->ReferenceOther(item);
 		}
+		else if (first->type == DataType::Set)
+		{
+			if (!second->AffirmSameType(DataType::Int))
+				return;
+
+			Set& s = *dynamic_cast<Value<Set>*>(first)->valuePtr;
+			int i = *dynamic_cast<Value<Int>*>(second)->valuePtr;
+			if (i == -1)
+				i = s.size() - 1;
+
+			if (i < 0 || i >= s.size())
+			{
+				second->token.PrintError("index out of range");
+				return;
+			}
+
+			// set items are plain values, the item at i is handed out as a new value
+			self->returnValue = Helper_NewSetItemValue(s.items[i], first->token);
+		}
+		else if (first->type == DataType::OrderedMap)
+		{
+			SetItem key;
+			if (!Helper_GetSetItem(second, key))
+				return;
+
+			Data** item = dynamic_cast<Value<OrderedMap>*>(first)->valuePtr->Find(key);
+			if (item == nullptr)
+			{
+				second->token.PrintError("key not found");
+				return;
+			}
+
+			(*item)->CreateSameType(self->returnValue);
+			self->returnValue->ReferenceOther(*item);
+		}
+		else if (first->type == DataType::Slice)
+		{
+			if (!second->AffirmSameType(DataType::Int))
+				return;
+
+			Slice& slice = *dynamic_cast<Value<Slice>*>(first)->valuePtr;
+			Value<Int>* index = dynamic_cast<Value<Int>*>(second);
+
+			int i = 0;
+			if (*index->valuePtr == -1)
+				i = slice.size() - 1;
+			else
+				i = *index->valuePtr;
+
+			if (i < 0 || i >= slice.size())
+			{
+				second->token.PrintError("index out of range");
+				return;
+			}
+
+			if (slice.source->type == DataType::String)
+			{
+				Value<String>* val = Memory<Value<String>>().New(DataType::String, false, first->token);
+				val->SetValue(std::string(1, dynamic_cast<Value<String>*>(slice.source)->valuePtr->at(slice.start + i)));
+				self->returnValue = val;
+			}
+			else
+			{
+				Data* item = dynamic_cast<Value<List>*>(slice.source)->valuePtr->at(slice.start + i);
+				item->CreateSameType(self->returnValue);
+				self->returnValue->ReferenceOther(item);
+			}
+		}
+		else if (first->type == DataType::Object && second->type == DataType::String && *dynamic_cast<Value<String>*>(second)->valuePtr == "__type__")
+		{
+			// scripts written against the map based objects read the type name this way
+			Value<String>* typeName = Memory<Value<String>>().New(DataType::String, false, first->token);
+			typeName->SetValue(dynamic_cast<Value<Object>*>(first)->valuePtr->nativeClass->name);
+			self->returnValue = typeName;
+		}
 		else if (first->type == DataType::String)
 		{
 			if (!second->AffirmSameType(DataType::Int))
@@ -477,7 +875,7 @@ void FunctionLibrary::F_GetElement(Function* self)
 
 			if (i < 0 || i >= str->valuePtr->size())
 			{
-				second->token.sourceCodePtr->PrintError(second->token, "index out of range");
+				second->token.PrintError("index out of range");
 				return;
 			}
 
@@ -491,7 +889,7 @@ void FunctionLibrary::F_GetElement(Function* self)
 		}
 		else
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected list or map");
+			first->token.PrintError("expected list, map or deque");
 		}
 }
 
@@ -502,6 +900,7 @@ void FunctionLibrary::F_RemoveElement(Function* self)
 
 	Data* first = self->arguments[0]->Evaluate();
 	AFFIRM_DATA(first)
+		first = Helper_PrepareChange(first);
 
 		Data* second = self->arguments[1]->Evaluate();
 	AFFIRM_DATA(second)
@@ -522,14 +921,11 @@ void FunctionLibrary::F_RemoveElement(Function* self)
 
 			if (i < 0 || i >= list->valuePtr->size())
 			{
-				second->token.sourceCodePtr->PrintError(second->token, "index out of range");
+				second->token.PrintError("index out of range");
 				return;
 			}
 
-			Data* item = list->valuePtr->at(i);
-			//delete item;
-			FreeData(item);
-			list->valuePtr->erase(list->valuePtr->begin() + i);
+			list->valuePtr->RemoveAt(i);
 		}
 		else if (first->type == DataType::Map)
 		{
@@ -543,7 +939,7 @@ void FunctionLibrary::F_RemoveElement(Function* self)
 
 			if (map->valuePtr->count(k) == 0)
 			{
-				second->token.sourceCodePtr->PrintError(second->token, "key not found");
+				second->token.PrintError("key not found");
 				return;
 			}
 
@@ -552,11 +948,28 @@ void FunctionLibrary::F_RemoveElement(Function* self)
 			FreeData(item);
 			map->valuePtr->erase(k);
 		}
+		else if (first->type == DataType::OrderedMap)
+		{
+			SetItem key;
+			if (!Helper_GetSetItem(second, key))
+				return;
+
+			OrderedMap& m = *dynamic_cast<Value<OrderedMap>*>(first)->valuePtr;
+			Data** item = m.Find(key);
+			if (item == nullptr)
+			{
+				second->token.PrintError("key not found");
+				return;
+			}
+
+			FreeData(*item);
+			m.erase(key);
+		}
 		else if (first->type == DataType::String)
 		{
 			if (first->isConst)
 			{
-				first->token.sourceCodePtr->PrintError(first->token, "cannot change literal string");
+				first->token.PrintError("cannot change literal string");
 				return;
 			}
 
@@ -574,7 +987,7 @@ void FunctionLibrary::F_RemoveElement(Function* self)
 
 			if (i < 0 || i >= str->valuePtr->size())
 			{
-				second->token.sourceCodePtr->PrintError(second->token, "index out of range");
+				second->token.PrintError("index out of range");
 				return;
 			}
 
@@ -582,10 +995,48 @@ void FunctionLibrary::F_RemoveElement(Function* self)
 		}
 		else
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected list, map or string");
+			first->token.PrintError("expected list, map, ordered_map or string");
 		}
 }
 
+void FunctionLibrary::Helper_PopElement(Function* self, bool front)
+{
+	if (!self->CheckArgumens(1))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+
+		if (!first->AffirmSameType(DataType::Deque))
+			return;
+
+	if (first->isConst)
+	{
+		first->token.PrintError("tried to change const container");
+		return;
+	}
+
+	Value<Deque>* deque = dynamic_cast<Value<Deque>*>(first);
+	if (deque->valuePtr->size() == 0)
+	{
+		first->token.PrintError("deque is empty");
+		return;
+	}
+
+	// the removed element itself becomes the return value, it is freed with it
+	self->returnValue = front ? deque->valuePtr->pop_front() : deque->valuePtr->pop_back();
+}
+
+void FunctionLibrary::F_PopFront(Function* self)
+{
+	Helper_PopElement(self, true);
+}
+
+void FunctionLibrary::F_PopBack(Function* self)
+{
+	Helper_PopElement(self, false);
+}
+
 void FunctionLibrary::F_HasKey(Function* self)
 {
 	if (!self->CheckArgumens(2))
@@ -597,12 +1048,24 @@ void FunctionLibrary::F_HasKey(Function* self)
 		Data* second = self->arguments[1]->Evaluate();
 	AFFIRM_DATA(second)
 
+		bool contains = false;
+	if (first->type == DataType::OrderedMap)
+	{
+		SetItem key;
+		if (!Helper_GetSetItem(second, key))
+			return;
+
+		contains = dynamic_cast<Value<OrderedMap>*>(first)->valuePtr->Find(key) != nullptr;
+	}
+	else
+	{
 		if (!first->AffirmSameType(DataType::Map) || !second->AffirmSameType(DataType::String))
 			return;
 
-	Value<Map>* map = dynamic_cast<Value<Map>*>(first);
-	Value<String>* str = dynamic_cast<Value<String>*>(second);
-	bool contains = (map->valuePtr->count(*str->valuePtr) != 0);
+		Value<Map>* map = dynamic_cast<Value<Map>*>(first);
+		Value<String>* str = dynamic_cast<Value<String>*>(second);
+		contains = (map->valuePtr->count(*str->valuePtr) != 0);
+	}
 
 	Value<Bool>* ret_val = Memory<Value<Bool>>().New(DataType::Bool, false, first->token);//new Value<Bool>(DataType::Bool, false, first->token);
 	ret_val->SetValue(contains);
@@ -619,7 +1082,7 @@ void FunctionLibrary::F_DefineFunction(Function* self)
 
 		if (first->type != DataType::String)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected variable name (string)");
+			first->token.PrintError("expected variable name (string)");
 			return;
 		}
 
@@ -628,7 +1091,7 @@ void FunctionLibrary::F_DefineFunction(Function* self)
 
 	if (!function->AffirmSameType(DataType::Function))
 	{
-		function->token.sourceCodePtr->PrintError(first->token, "expected function");
+		first->token.PrintError("expected function");
 		return;
 	}
 
@@ -637,9 +1100,9 @@ void FunctionLibrary::F_DefineFunction(Function* self)
 	function->CreateSameType(function_ref);
 	function_ref->ReferenceOther(function);
 
-	if (!self->parent->AddVariable(*name->valuePtr, function_ref))
+	if (!self->parent->AddVariable(Helper_GetName(self, name), function_ref))
 	{
-		first->token.sourceCodePtr->PrintError(first->token, "name is already defined");
+		first->token.PrintError("name is already defined");
 		return;
 	}
 
@@ -650,13 +1113,13 @@ void FunctionLibrary::F_DefineFunction(Function* self)
 
 			if (!param->AffirmSameType(DataType::String))
 			{
-				param->token.sourceCodePtr->PrintError(param->token, "expected parameter name");
+				param->token.PrintError("expected parameter name");
 				return;
 			}
 
 		Value<String>* param_str = dynamic_cast<Value<String>*>(param);
 
-		dynamic_cast<Value<Function>*>(function_ref)->valuePtr->parameterNames.push_back(*param_str->valuePtr);
+		dynamic_cast<Value<Function>*>(function_ref)->valuePtr->parameterNames.push_back(VariableName(*param_str->valuePtr));
 	}
 }
 
@@ -670,16 +1133,16 @@ void FunctionLibrary::F_GetVariable(Function* self)
 
 		if (first->type != DataType::String)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected variable name (string)");
+			first->token.PrintError("expected variable name (string)");
 			return;
 		}
 
 	Value<String>* name = dynamic_cast<Value<String>*>(first);
 	Data* var = nullptr;
 
-	if (!self->GetVariable(*name->valuePtr, var))
+	if (!self->GetVariable(Helper_GetName(self, name), var))
 	{
-		first->token.sourceCodePtr->PrintError(first->token, "variable is not defined");
+		first->token.PrintError("variable is not defined");
 		return;
 	}
 
@@ -697,22 +1160,22 @@ void FunctionLibrary::F_GetFunctionReference(Function* self)
 
 		if (first->type != DataType::String)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected function name (string)");
+			first->token.PrintError("expected function name (string)");
 			return;
 		}
 
 	Value<String>* name = dynamic_cast<Value<String>*>(first);
 	Data* var = nullptr;
 
-	if (!self->GetVariable(*name->valuePtr, var))
+	if (!self->GetVariable(Helper_GetName(self, name), var))
 	{
-		first->token.sourceCodePtr->PrintError(first->token, "function is not defined");
+		first->token.PrintError("function is not defined");
 		return;
 	}
 
 	if (var->type != DataType::Function)
 	{
-		first->token.sourceCodePtr->PrintError(first->token, "the variable is not of type function");
+		first->token.PrintError("the variable is not of type function");
 		return;
 	}
 
@@ -730,7 +1193,7 @@ void FunctionLibrary::F_FunctionReference(Function* self)
 	Data* last = self->arguments.back();
 	if (last->type != DataType::Function)
 	{
-		last->token.sourceCodePtr->PrintError(last->token, "the argument is not of type function");
+		last->token.PrintError("the argument is not of type function");
 		return;
 	}
 
@@ -748,12 +1211,12 @@ void FunctionLibrary::F_FunctionReference(Function* self)
 
 			if (!param->AffirmSameType(DataType::String))
 			{
-				param->token.sourceCodePtr->PrintError(param->token, "expected parameter name");
+				param->token.PrintError("expected parameter name");
 				return;
 			}
 
 		Value<String>* param_str = dynamic_cast<Value<String>*>(param);
-		dynamic_cast<Value<Function>*>(self->returnValue)->valuePtr->parameterNames.push_back(*param_str->valuePtr);
+		dynamic_cast<Value<Function>*>(self->returnValue)->valuePtr->parameterNames.push_back(VariableName(*param_str->valuePtr));
 	}
 }
 
@@ -767,7 +1230,7 @@ void FunctionLibrary::F_EvaluateFunction(Function* self)
 
 		if (first->type != DataType::Function)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected a function");
+			first->token.PrintError("expected a function");
 			return;
 		}
 
@@ -801,7 +1264,7 @@ void FunctionLibrary::F_If(Function* self)
 
 		if (condition->type != DataType::Bool)
 		{
-			condition->token.sourceCodePtr->PrintError(condition->token, "expected boolean");
+			condition->token.PrintError("expected boolean");
 			return;
 		}
 
@@ -834,7 +1297,7 @@ void FunctionLibrary::F_While(Function* self)
 
 		if (condition->type != DataType::Bool)
 		{
-			condition->token.sourceCodePtr->PrintError(condition->token, "expected boolean");
+			condition->token.PrintError("expected boolean");
 			return;
 		}
 
@@ -856,7 +1319,7 @@ void FunctionLibrary::F_While(Function* self)
 
 			if (condition->type != DataType::Bool)
 			{
-				condition->token.sourceCodePtr->PrintError(condition->token, "expected boolean");
+				condition->token.PrintError("expected boolean");
 				return;
 			}
 
@@ -880,7 +1343,12 @@ void FunctionLibrary::F_TypeOf(Function* self)
 		"string",
 		"list",
 		"map",
-		"function"
+		"function",
+		"deque",
+		"object",
+		"slice",
+		"set",
+		"ordered_map"
 	};
 
 	std::string typeName;
@@ -901,6 +1369,12 @@ void FunctionLibrary::F_TypeOf(Function* self)
 		}
 	}
 
+	if (data->type == DataType::Object)
+	{
+		typeName = dynamic_cast<Value<Object>*>(data)->valuePtr->nativeClass->name;
+		customType = true;
+	}
+
 	if (!customType)
 	{
 		int index = (int)data->type;
@@ -912,40 +1386,52 @@ void FunctionLibrary::F_TypeOf(Function* self)
 	self->returnValue = str_val;
 }
 
-void FunctionLibrary::F_ToString(Function* self)
+bool FunctionLibrary::Helper_ToString(Data* data, std::string& outStr)
 {
-	if (!self->CheckArgumens(1))
-		return;
-
-	Data* data = self->arguments[0]->Evaluate();
-	AFFIRM_DATA(data)
-
-		std::string str;
 	if (data->type == DataType::Bool)
 	{
 		Value<Bool>* b = dynamic_cast<Value<Bool>*>(data);
-		str = *b->valuePtr ? "true" : "false";
+		outStr = *b->valuePtr ? "true" : "false";
 	}
 	else if (data->type == DataType::Int)
 	{
 		Value<Int>* i = dynamic_cast<Value<Int>*>(data);
-		str = std::to_string(*i->valuePtr);
+		outStr = std::to_string(*i->valuePtr);
 	}
 	else if (data->type == DataType::Float)
 	{
 		Value<Float>* f = dynamic_cast<Value<Float>*>(data);
-		str = std::to_string(*f->valuePtr);
+		outStr = std::to_string(*f->valuePtr);
 	}
 	else if (data->type == DataType::String)
 	{
 		Value<String>* s = dynamic_cast<Value<String>*>(data);
-		str = *s->valuePtr;
+		outStr = *s->valuePtr;
+	}
+	else if (data->type == DataType::Slice && dynamic_cast<Value<Slice>*>(data)->valuePtr->source->type == DataType::String)
+	{
+		Slice& slice = *dynamic_cast<Value<Slice>*>(data)->valuePtr;
+		outStr = dynamic_cast<Value<String>*>(slice.source)->valuePtr->substr(slice.start, slice.size());
 	}
 	else
 	{
-		data->token.sourceCodePtr->PrintError(data->token, "expected bool, int, float or string");
-		return;
+		data->token.PrintError("expected bool, int, float, string or string slice");
+		return false;
 	}
+	return true;
+}
+
+void FunctionLibrary::F_ToString(Function* self)
+{
+	if (!self->CheckArgumens(1))
+		return;
+
+	Data* data = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(data)
+
+		std::string str;
+	if (!Helper_ToString(data, str))
+		return;
 
 	Value<String>* str_val = Memory<Value<String>>().New(DataType::String, false, data->token);//new Value<String>(DataType::String, false, data->token);
 	str_val->SetValue(str);
@@ -992,7 +1478,7 @@ void FunctionLibrary::F_ToInt(Function* self)
 		Value<String>* s = dynamic_cast<Value<String>*>(data);
 		if (!Helper_IsInt(*s->valuePtr))
 		{
-			data->token.sourceCodePtr->PrintError(data->token, "failed to convert string into int");
+			data->token.PrintError("failed to convert string into int");
 			return;
 		}
 		i = std::stoi(*s->valuePtr);
@@ -1004,7 +1490,7 @@ void FunctionLibrary::F_ToInt(Function* self)
 	}
 	else
 	{
-		data->token.sourceCodePtr->PrintError(data->token, "expected string or float");
+		data->token.PrintError("expected string or float");
 		return;
 	}
 
@@ -1027,7 +1513,7 @@ void FunctionLibrary::F_ToFloat(Function* self)
 		Value<String>* s = dynamic_cast<Value<String>*>(data);
 		if (!Helper_IsFloat(*s->valuePtr))
 		{
-			data->token.sourceCodePtr->PrintError(data->token, "failed to convert string into float");
+			data->token.PrintError("failed to convert string into float");
 			return;
 		}
 		f = std::stof(*s->valuePtr);
@@ -1039,7 +1525,7 @@ void FunctionLibrary::F_ToFloat(Function* self)
 	}
 	else
 	{
-		data->token.sourceCodePtr->PrintError(data->token, "expected string or int");
+		data->token.PrintError("expected string or int");
 		return;
 	}
 
@@ -1054,14 +1540,14 @@ void FunctionLibrary::F_Add(Function* self)
 		return;
 
 	DataType t;
-	Data* left = self->arguments[0]->Evaluate();
+	Data* left = Helper_ReadValue(self->arguments[0]);
 	AFFIRM_DATA(left)
-		Data* right = self->arguments[1]->Evaluate();
+		Data* right = Helper_ReadValue(self->arguments[1]);
 	AFFIRM_DATA(right)
 
 		if ((t = left->type) != right->type || (t != DataType::Int && t != DataType::Float && t != DataType::String))
 		{
-			left->token.sourceCodePtr->PrintError(left->token, "type mismatch");
+			left->token.PrintError("type mismatch");
 			return;
 		}
 
@@ -1110,14 +1596,14 @@ void FunctionLibrary::F_Sub(Function* self)
 		return;
 
 	DataType t;
-	Data* left = self->arguments[0]->Evaluate();
+	Data* left = Helper_ReadValue(self->arguments[0]);
 	AFFIRM_DATA(left)
-		Data* right = self->arguments[1]->Evaluate();
+		Data* right = Helper_ReadValue(self->arguments[1]);
 	AFFIRM_DATA(right)
 
 		if ((t = left->type) != right->type || (t != DataType::Int && t != DataType::Float))
 		{
-			left->token.sourceCodePtr->PrintError(left->token, "type mismatch");
+			left->token.PrintError("type mismatch");
 			return;
 		}
 
@@ -1149,14 +1635,14 @@ void FunctionLibrary::F_Mult(Function* self)
 		return;
 
 	DataType t;
-	Data* left = self->arguments[0]->Evaluate();
+	Data* left = Helper_ReadValue(self->arguments[0]);
 	AFFIRM_DATA(left)
-		Data* right = self->arguments[1]->Evaluate();
+		Data* right = Helper_ReadValue(self->arguments[1]);
 	AFFIRM_DATA(right)
 
 		if ((t = left->type) != right->type || (t != DataType::Int && t != DataType::Float))
 		{
-			left->token.sourceCodePtr->PrintError(left->token, "type mismatch");
+			left->token.PrintError("type mismatch");
 			return;
 		}
 
@@ -1188,14 +1674,14 @@ void FunctionLibrary::F_Div(Function* self)
 		return;
 
 	DataType t;
-	Data* left = self->arguments[0]->Evaluate();
+	Data* left = Helper_ReadValue(self->arguments[0]);
 	AFFIRM_DATA(left)
-		Data* right = self->arguments[1]->Evaluate();
+		Data* right = Helper_ReadValue(self->arguments[1]);
 	AFFIRM_DATA(right)
 
 		if ((t = left->type) != right->type || (t != DataType::Int && t != DataType::Float))
 		{
-			left->token.sourceCodePtr->PrintError(left->token, "type mismatch");
+			left->token.PrintError("type mismatch");
 			return;
 		}
 
@@ -1227,14 +1713,14 @@ void FunctionLibrary::F_Less(Function* self)
 		return;
 
 	DataType t;
-	Data* left = self->arguments[0]->Evaluate();
+	Data* left = Helper_ReadValue(self->arguments[0]);
 	AFFIRM_DATA(left)
-		Data* right = self->arguments[1]->Evaluate();
+		Data* right = Helper_ReadValue(self->arguments[1]);
 	AFFIRM_DATA(right)
 
 		if ((t = left->type) != right->type || (t != DataType::Int && t != DataType::Float))
 		{
-			left->token.sourceCodePtr->PrintError(left->token, "type mismatch");
+			left->token.PrintError("type mismatch");
 			return;
 		}
 
@@ -1266,14 +1752,26 @@ void FunctionLibrary::F_Equal(Function* self)
 		return;
 
 	DataType t;
-	Data* left = self->arguments[0]->Evaluate();
+	Data* left = Helper_ReadValue(self->arguments[0]);
 	AFFIRM_DATA(left)
-		Data* right = self->arguments[1]->Evaluate();
+		Data* right = Helper_ReadValue(self->arguments[1]);
 	AFFIRM_DATA(right)
 
-		if ((t = left->type) != right->type || (t != DataType::Bool && t != DataType::Int && t != DataType::Float && t != DataType::String))
+		// string slices are compared by text with each other and with strings
+		const char* leftText = nullptr;
+	const char* rightText = nullptr;
+	int leftLength = 0, rightLength = 0;
+	if ((left->type == DataType::Slice || right->type == DataType::Slice) && Helper_GetText(left, leftText, leftLength) && Helper_GetText(right, rightText, rightLength))
+	{
+		Value<Bool>* comp = Memory<Value<Bool>>().New(DataType::Bool, false, left->token);
+		comp->SetValue(leftLength == rightLength && std::equal(leftText, leftText + leftLength, rightText));
+		self->returnValue = comp;
+		return;
+	}
+
+	if ((t = left->type) != right->type || (t != DataType::Bool && t != DataType::Int && t != DataType::Float && t != DataType::String))
 		{
-			left->token.sourceCodePtr->PrintError(left->token, "type mismatch");
+			left->token.PrintError("type mismatch");
 			return;
 		}
 
@@ -1332,7 +1830,7 @@ void FunctionLibrary::F_And(Function* self)
 
 		if ((t = left->type) != right->type || t != DataType::Bool)
 		{
-			left->token.sourceCodePtr->PrintError(left->token, "expected bool");
+			left->token.PrintError("expected bool");
 			return;
 		}
 
@@ -1358,7 +1856,7 @@ void FunctionLibrary::F_Or(Function* self)
 
 		if ((t = left->type) != right->type || t != DataType::Bool)
 		{
-			left->token.sourceCodePtr->PrintError(left->token, "expected bool");
+			left->token.PrintError("expected bool");
 			return;
 		}
 
@@ -1381,7 +1879,7 @@ void FunctionLibrary::F_Not(Function* self)
 
 		if (first->type != DataType::Bool)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected bool");
+			first->token.PrintError("expected bool");
 			return;
 		}
 
@@ -1409,6 +1907,31 @@ void FunctionLibrary::F_Count(Function* self)
 			count->SetValue((int)list->valuePtr->size());
 			self->returnValue = count;
 		}
+		else if (first->type == DataType::Slice)
+		{
+			Value<Int>* count = Memory<Value<Int>>().New(DataType::Int, false, first->token);
+			count->SetValue(dynamic_cast<Value<Slice>*>(first)->valuePtr->size());
+			self->returnValue = count;
+		}
+		else if (first->type == DataType::Deque)
+		{
+			Value<Deque>* deque = dynamic_cast<Value<Deque>*>(first);
+			Value<Int>* count = Memory<Value<Int>>().New(DataType::Int, false, first->token);
+			count->SetValue(deque->valuePtr->size());
+			self->returnValue = count;
+		}
+		else if (first->type == DataType::Set)
+		{
+			Value<Int>* count = Memory<Value<Int>>().New(DataType::Int, false, first->token);
+			count->SetValue(dynamic_cast<Value<Set>*>(first)->valuePtr->size());
+			self->returnValue = count;
+		}
+		else if (first->type == DataType::OrderedMap)
+		{
+			Value<Int>* count = Memory<Value<Int>>().New(DataType::Int, false, first->token);
+			count->SetValue(dynamic_cast<Value<OrderedMap>*>(first)->valuePtr->size());
+			self->returnValue = count;
+		}
 		else if (first->type == DataType::String)
 		{
 			Value<String>* str = dynamic_cast<Value<String>*>(first);
@@ -1419,7 +1942,7 @@ void FunctionLibrary::F_Count(Function* self)
 		}
 		else
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected list or string");
+			first->token.PrintError("expected list, deque, set, ordered_map, slice or string");
 		}
 }
 
@@ -1431,527 +1954,2124 @@ void FunctionLibrary::F_Keys(Function* self)
 	Data* first = self->arguments[0]->Evaluate();
 	AFFIRM_DATA(first)
 
-		if (first->type != DataType::Map)
+		if (first->type == DataType::OrderedMap)
 		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected map");
+			self->returnValue = Helper_OrderedKeys(*dynamic_cast<Value<OrderedMap>*>(first)->valuePtr, first->token);
 			return;
 		}
 
+	if (first->type != DataType::Map)
+	{
+		first->token.PrintError("expected map or ordered_map");
+		return;
+	}
+
 	Value<Map>* map = dynamic_cast<Value<Map>*>(first);
 	//Value<List>* list = new Value<List>(DataType::List, false, first->token);
 	Value<List>* list = Memory<Value<List>>().New(DataType::List, false, first->token);
 	list->Init();
 
-	for (auto& e : map->valuePtr->map)
+	// keys come out in insertion order
+	for (auto& e : *map->valuePtr)
 	{
 		//Value<String>* key = new Value<String>(DataType::String, false, first->token);
 		Value<String>* key = Memory<Value<String>>().New(DataType::String, false, first->token);
-		key->SetValue(e.first);
+		key->SetValue(e.key);
 		list->valuePtr->push_back(key);
 	}
 
 	self->returnValue = list;
 }
 
-void FunctionLibrary::F_CallCPPFunction(Function* self)
+bool FunctionLibrary::Helper_GetNumbers(Data* data, NumberList& outNumbers)
 {
-	if (!self->CheckArgumens(1))
-		return;
+	// a slice of a list is read in place, starting at its offset
+	if (data->type == DataType::Slice && dynamic_cast<Value<Slice>*>(data)->valuePtr->source->type == DataType::List)
+	{
+		Slice& slice = *dynamic_cast<Value<Slice>*>(data)->valuePtr;
+		if (!Helper_GetNumbers(slice.source, outNumbers))
+			return false;
 
-	Data* first = self->arguments[0]->Evaluate();
-	AFFIRM_DATA(first)
+		outNumbers.count = slice.size();
+		outNumbers.ints = outNumbers.type == DataType::Int ? outNumbers.ints + slice.start : nullptr;
+		outNumbers.floats = outNumbers.type == DataType::Float ? outNumbers.floats + slice.start : nullptr;
+		return true;
+	}
 
-		if (first->type != DataType::String)
-		{
-			first->token.sourceCodePtr->PrintError(first->token, "expected function name (string)");
-			return;
-		}
+	if (data->type != DataType::List)
+	{
+		data->token.PrintError("expected list");
+		return false;
+	}
 
-	Value<String>* name = dynamic_cast<Value<String>*>(first);
-	if (Script::scriptFunctions.count(*name->valuePtr) == 0)
+	List& l = *dynamic_cast<Value<List>*>(data)->valuePtr;
+	outNumbers.count = l.size();
+	outNumbers.ints = nullptr;
+	outNumbers.floats = nullptr;
+
+	if (l.packedType == DataType::Int || l.packedType == DataType::Float)
 	{
-		first->token.sourceCodePtr->PrintError(first->token, "function not defined");
-		return;
+		outNumbers.type = l.packedType;
+		outNumbers.ints = l.ints.data();
+		outNumbers.floats = l.floats.data();
+		return true;
 	}
 
-	List args;
-	for (int i = 1; i < self->arguments.size(); i++)
+	// a boxed list is read element by element, it is not packed back since its elements may be referenced
+	outNumbers.type = l.list.empty() ? DataType::Int : l.list[0]->type;
+	if (l.packedType == DataType::List && (outNumbers.type == DataType::Int || outNumbers.type == DataType::Float))
 	{
-		Data* argRef = nullptr;
-		Data* arg = self->arguments[i]->Evaluate();
-		AFFIRM_DATA(arg)
+		for (auto& elem : l.list)
+		{
+			if (elem->type != outNumbers.type)
+				break;
 
-			arg->CreateSameType(argRef);
-		argRef->ReferenceOther(arg);
-		args.push_back(argRef);
+			if (elem->type == DataType::Int)
+				outNumbers.intCopies.push_back(*dynamic_cast<Value<Int>*>(elem)->valuePtr);
+			else
+				outNumbers.floatCopies.push_back(*dynamic_cast<Value<Float>*>(elem)->valuePtr);
+		}
+
+		if ((int)(outNumbers.intCopies.size() + outNumbers.floatCopies.size()) == outNumbers.count)
+		{
+			outNumbers.ints = outNumbers.intCopies.data();
+			outNumbers.floats = outNumbers.floatCopies.data();
+			return true;
+		}
 	}
 
-	Script::scriptFunctions[*name->valuePtr](args);
+	data->token.PrintError("expected list of ints or list of floats");
+	return false;
 }
 
-
-Script::Script()
+Value<List>* FunctionLibrary::Helper_NewNumberList(DataType type, int count, const Token& token)
 {
-	rootFunction = nullptr;
-}
-
-std::string Script::workingDirectory;
-std::unordered_map<std::string, void(*)(List&)> Script::scriptFunctions;
+	Value<List>* list = Memory<Value<List>>().New(DataType::List, false, token);
+	list->Init();
+	list->valuePtr->packedType = type;
+	list->valuePtr->packedToken = token;
+	if (type == DataType::Int)
+		list->valuePtr->ints.resize(count);
+	else if (type == DataType::Float)
+		list->valuePtr->floats.resize(count);
+	else
+		list->valuePtr->bools.resize(count);
 
-bool Script::IsDigit(char c)
-{
-	return c >= '0' && c <= '9';
+	return list;
 }
 
-bool Script::IsWhitespace(char c)
+void FunctionLibrary::Helper_Elementwise(Function* self, void(*intOp)(const int*, const int*, int*, int), void(*floatOp)(const float*, const float*, float*, int))
 {
-	return c == ' ' || c == '\n' || c == '\t';
-}
+	if (!self->CheckArgumens(2))
+		return;
 
-bool Script::IsDelimiter(char c)
-{
-	return IsWhitespace(c) || c == '(' || c == ')';
-}
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+		Data* second = self->arguments[1]->Evaluate();
+	AFFIRM_DATA(second)
 
-bool Script::ApplyIncludes()
-{
-	while (true)
+		NumberList a, b;
+	if (!Helper_GetNumbers(first, a) || !Helper_GetNumbers(second, b))
+		return;
+
+	if (a.count != b.count || (a.type != b.type && a.count > 0))
 	{
-		if (sourceCode.BeginsWith("/*"))
-		{
-			for (; sourceCode.NextChar() && !sourceCode.BeginsWith("*/"););
+		first->token.PrintError("expected lists of the same length and type");
+		return;
+	}
 
-			sourceCode.NextChar();
-		}
-		else if (sourceCode.BeginsWith("//"))
-		{
-			for (; sourceCode.NextChar() && sourceCode.CurrentChar() != '\n';);
-		}
-		else if (sourceCode.CurrentChar() == '"')
-		{
-			for (; sourceCode.NextChar() && sourceCode.CurrentChar() != '"';);
-		}
-		else if (sourceCode.BeginsWith("#include"))
-		{
-			size_t includeStartIndex = sourceCode.index;
-			sourceCode.MoveAlong(8);
+	Value<List>* result = Helper_NewNumberList(a.type, a.count, first->token);
+	if (a.type == DataType::Int)
+		intOp(a.ints, b.ints, result->valuePtr->ints.data(), a.count);
+	else
+		floatOp(a.floats, b.floats, result->valuePtr->floats.data(), a.count);
 
-			std::string includeString = workingDirectory;
-			char c;
-			int quotationMarks = 0;
-			for (; sourceCode.NextChar();)
-			{
-				if ((c = sourceCode.CurrentChar()) == '"')
-				{
-					if (++quotationMarks == 2)
-						break;
-				}
-				else if (quotationMarks == 1)
-					includeString += c;
-			}
+	self->returnValue = result;
+}
 
-			if (quotationMarks != 2)
-			{
-				sourceCode.PrintErrorAtCurrentIndex("missing '\"' after #include");
-				return false;
-			}
+void FunctionLibrary::F_Sum(Function* self)
+{
+	if (!self->CheckArgumens(1))
+		return;
 
-			SourceCode includeCode;
-			if (!includeCode.ReadFile(includeString))
-			{
-				sourceCode.PrintErrorAtCurrentIndex("failed to include file");
-				return false;
-			}
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
 
-			sourceCode.text.erase(includeStartIndex, sourceCode.index - includeStartIndex + 2);
-			sourceCode.text.insert(sourceCode.text.begin() + includeStartIndex, includeCode.text.begin(), includeCode.text.end());
-			sourceCode.index = includeStartIndex;
-			continue;
-		}
+		NumberList numbers;
+	if (!Helper_GetNumbers(first, numbers))
+		return;
 
-		if (!sourceCode.NextChar())
-			break;
+	if (numbers.type == DataType::Int)
+	{
+		Value<Int>* sum = Memory<Value<Int>>().New(DataType::Int, false, first->token);
+		sum->SetValue(Simd().sumInt(numbers.ints, numbers.count));
+		self->returnValue = sum;
+	}
+	else
+	{
+		Value<Float>* sum = Memory<Value<Float>>().New(DataType::Float, false, first->token);
+		sum->SetValue(Simd().sumFloat(numbers.floats, numbers.count));
+		self->returnValue = sum;
 	}
-
-	sourceCode.Reset();
-	return true;
 }
 
-void Script::HideStrings()
+void FunctionLibrary::F_Min(Function* self)
 {
-	while (true)
-	{
-		if (sourceCode.BeginsWith("/*"))
-		{
-			for (; sourceCode.NextChar() && !sourceCode.BeginsWith("*/"););
+	if (!self->CheckArgumens(1))
+		return;
 
-			sourceCode.NextChar();
-		}
-		else if (sourceCode.BeginsWith("//"))
-		{
-			for (; sourceCode.NextChar() && sourceCode.CurrentChar() != '\n';);
-		}
-		else if (sourceCode.BeginsWith("#macro"))
-		{
-			for (; sourceCode.NextChar() && sourceCode.CurrentChar() != '\n';);
-		}
-		else if (sourceCode.CurrentChar() == '"')
-		{
-			int startIndex = sourceCode.index;
-			std::string str = "\"";
-			for (; sourceCode.NextChar() && sourceCode.CurrentChar() != '"';)
-			{
-				str += sourceCode.CurrentChar();
-			}
-			str += "\"";
-			int endIndex = sourceCode.index;
-			std::string key = "@" + std::to_string(nextHiddenStringIndex++) + "@";
-			hiddenStrings[key] = str;
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
 
-			sourceCode.text.erase(startIndex, endIndex - startIndex + 1);
-			sourceCode.text.insert(sourceCode.text.begin() + startIndex, key.begin(), key.end());
-			sourceCode.index = startIndex + key.size();
-		}
+		NumberList numbers;
+	if (!Helper_GetNumbers(first, numbers))
+		return;
 
-		if (!sourceCode.NextChar())
-			break;
+	if (numbers.count == 0)
+	{
+		first->token.PrintError("list is empty");
+		return;
 	}
 
-	sourceCode.Reset();
+	if (numbers.type == DataType::Int)
+	{
+		Value<Int>* min = Memory<Value<Int>>().New(DataType::Int, false, first->token);
+		min->SetValue(Simd().minInt(numbers.ints, numbers.count));
+		self->returnValue = min;
+	}
+	else
+	{
+		Value<Float>* min = Memory<Value<Float>>().New(DataType::Float, false, first->token);
+		min->SetValue(Simd().minFloat(numbers.floats, numbers.count));
+		self->returnValue = min;
+	}
 }
 
-void Script::RemoveComments()
+void FunctionLibrary::F_Max(Function* self)
 {
-	std::regex commentsRgx("(?:\\/\\/.*)|(?:\\/\\*[\\S\\s]*?\\*\\/)");
-	sourceCode.text = std::regex_replace(sourceCode.text, commentsRgx, "", std::regex_constants::format_default);
-}
+	if (!self->CheckArgumens(1))
+		return;
 
-bool Script::ApplyMacros()
-{
-	while (true)
-	{
-		if (sourceCode.BeginsWith("#macro"))
-		{
-			size_t macroStartIndex = sourceCode.index;
-			sourceCode.MoveAlong(6);
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
 
-			std::string regexStr;
-			bool goNext = true;
-			char c;
-			for (; (goNext = sourceCode.NextChar()) && !IsWhitespace(c = sourceCode.CurrentChar());)
-				regexStr += c;
+		NumberList numbers;
+	if (!Helper_GetNumbers(first, numbers))
+		return;
 
-			if (!goNext)
-			{
-				sourceCode.PrintErrorAtCurrentIndex("incomplete macro");
-				return false;
-			}
+	if (numbers.count == 0)
+	{
+		first->token.PrintError("list is empty");
+		return;
+	}
 
-			std::regex rgxName("(\\$name)");
-			std::regex rgxAny("(\\$any)");
-			regexStr = std::regex_replace(regexStr, rgxName, "[a-zA-Z_][a-zA-Z0-9_]*", std::regex_constants::format_default);
-			regexStr = std::regex_replace(regexStr, rgxAny, "[\\S\\s]*?", std::regex_constants::format_default);
+	if (numbers.type == DataType::Int)
+	{
+		Value<Int>* max = Memory<Value<Int>>().New(DataType::Int, false, first->token);
+		max->SetValue(Simd().maxInt(numbers.ints, numbers.count));
+		self->returnValue = max;
+	}
+	else
+	{
+		Value<Float>* max = Memory<Value<Float>>().New(DataType::Float, false, first->token);
+		max->SetValue(Simd().maxFloat(numbers.floats, numbers.count));
+		self->returnValue = max;
+	}
+}
 
-			std::string expansionStr;
-			for (; sourceCode.NextChar() && (c = sourceCode.CurrentChar()) != '\n';)
-				expansionStr += c;
+void FunctionLibrary::F_Dot(Function* self)
+{
+	if (!self->CheckArgumens(2))
+		return;
 
-			std::string restOfText = sourceCode.Substring(sourceCode.index + 1, sourceCode.text.size() - 1);
-			std::string result;
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+		Data* second = self->arguments[1]->Evaluate();
+	AFFIRM_DATA(second)
 
-			try
-			{
-				std::regex rgx(regexStr);
-				result = std::regex_replace(restOfText, rgx, expansionStr, std::regex_constants::format_default);
-			}
-			catch (const std::regex_error& e) {
-				sourceCode.PrintErrorAtCurrentIndex("regex: " + regexStr + " " + e.what());
-				return false;
-			}
+		NumberList a, b;
+	if (!Helper_GetNumbers(first, a) || !Helper_GetNumbers(second, b))
+		return;
 
-			sourceCode.text.resize(macroStartIndex);
-			sourceCode.text.append(result.begin(), result.end());
-			sourceCode.index = macroStartIndex;
-			continue;
-		}
+	if (a.count != b.count || (a.type != b.type && a.count > 0))
+	{
+		first->token.PrintError("expected lists of the same length and type");
+		return;
+	}
 
-		if (!sourceCode.NextChar())
-			break;
+	if (a.type == DataType::Int)
+	{
+		Value<Int>* dot = Memory<Value<Int>>().New(DataType::Int, false, first->token);
+		dot->SetValue(Simd().dotInt(a.ints, b.ints, a.count));
+		self->returnValue = dot;
+	}
+	else
+	{
+		Value<Float>* dot = Memory<Value<Float>>().New(DataType::Float, false, first->token);
+		dot->SetValue(Simd().dotFloat(a.floats, b.floats, a.count));
+		self->returnValue = dot;
 	}
+}
 
-	sourceCode.Reset();
-	return true;
+void FunctionLibrary::F_VAdd(Function* self)
+{
+	Helper_Elementwise(self, Simd().addInt, Simd().addFloat);
 }
 
-void Script::ShowStrings()
+void FunctionLibrary::F_VSub(Function* self)
 {
-	for (auto& str : hiddenStrings)
-	{
-		std::regex strRgx("(" + str.first + ")");
-		sourceCode.text = std::regex_replace(sourceCode.text, strRgx, str.second, std::regex_constants::format_default);
-	}
+	Helper_Elementwise(self, Simd().subInt, Simd().subFloat);
 }
 
-bool Script::ApplyPreprocessing()
+void FunctionLibrary::F_VMul(Function* self)
 {
-	bool logExpanded = sourceCode.BeginsWith("#log_expanded");
-	std::string logFilename;
-	if (logExpanded)
-	{
-		sourceCode.MoveAlong(13);
-		char c;
-		for (; (c = sourceCode.CurrentChar()) != '"' && c != '\n' && sourceCode.NextChar(););
+	Helper_Elementwise(self, Simd().mulInt, Simd().mulFloat);
+}
 
-		if (c == '"')
-		{
-			sourceCode.NextChar();
-			for (; (c = sourceCode.CurrentChar()) != '"' && sourceCode.NextChar();)
-				logFilename += c;
+void FunctionLibrary::F_VScale(Function* self)
+{
+	if (!self->CheckArgumens(2))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+		Data* second = self->arguments[1]->Evaluate();
+	AFFIRM_DATA(second)
+
+		NumberList numbers;
+	if (!Helper_GetNumbers(first, numbers))
+		return;
+
+	// an empty list takes the type of the scale
+	if (numbers.count == 0 && second->type == DataType::Float)
+		numbers.type = DataType::Float;
+
+	if (second->type != numbers.type)
+	{
+		second->token.PrintError(numbers.type == DataType::Int ? "expected int" : "expected float");
+		return;
+	}
+
+	Value<List>* result = Helper_NewNumberList(numbers.type, numbers.count, first->token);
+	if (numbers.type == DataType::Int)
+		Simd().scaleInt(numbers.ints, *dynamic_cast<Value<Int>*>(second)->valuePtr, result->valuePtr->ints.data(), numbers.count);
+	else
+		Simd().scaleFloat(numbers.floats, *dynamic_cast<Value<Float>*>(second)->valuePtr, result->valuePtr->floats.data(), numbers.count);
+
+	self->returnValue = result;
+}
+
+void FunctionLibrary::F_Fill(Function* self)
+{
+	if (!self->CheckArgumens(2))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+		Data* second = self->arguments[1]->Evaluate();
+	AFFIRM_DATA(second)
+
+		if (first->type != DataType::Int || *dynamic_cast<Value<Int>*>(first)->valuePtr < 0)
+		{
+			first->token.PrintError("expected count (non negative int)");
+			return;
+		}
+
+	int count = *dynamic_cast<Value<Int>*>(first)->valuePtr;
+	Value<List>* result = nullptr;
+	if (second->type == DataType::Int)
+	{
+		result = Helper_NewNumberList(DataType::Int, 0, second->token);
+		result->valuePtr->ints.assign(count, *dynamic_cast<Value<Int>*>(second)->valuePtr);
+	}
+	else if (second->type == DataType::Float)
+	{
+		result = Helper_NewNumberList(DataType::Float, 0, second->token);
+		result->valuePtr->floats.assign(count, *dynamic_cast<Value<Float>*>(second)->valuePtr);
+	}
+	else if (second->type == DataType::Bool)
+	{
+		result = Helper_NewNumberList(DataType::Bool, 0, second->token);
+		result->valuePtr->bools.assign(count, *dynamic_cast<Value<Bool>*>(second)->valuePtr ? 1 : 0);
+	}
+	else
+	{
+		second->token.PrintError("expected int, float or bool");
+		return;
+	}
+
+	self->returnValue = result;
+}
+
+void FunctionLibrary::F_Range(Function* self)
+{
+	if (!self->CheckArgumens(2))
+		return;
+
+	int bounds[3] = { 0, 0, 1 };
+	for (int i = 0; i < 3 && i < (int)self->arguments.size(); i++)
+	{
+		Data* arg = self->arguments[i]->Evaluate();
+		AFFIRM_DATA(arg)
+
+			if (arg->type != DataType::Int)
+			{
+				arg->token.PrintError("expected int");
+				return;
+			}
+
+		bounds[i] = *dynamic_cast<Value<Int>*>(arg)->valuePtr;
+		if (i == 2 && bounds[i] == 0)
+		{
+			arg->token.PrintError("step can not be zero");
+			return;
+		}
+	}
+
+	// counts from first up to (or down to) last, last is not included
+	long long first = bounds[0], last = bounds[1], step = bounds[2];
+	long long count = step > 0 ? (last - first + step - 1) / step : (first - last - step - 1) / -step;
+	if (count < 0)
+		count = 0;
+	else if (count > 0x7FFFFFFF)
+	{
+		self->arguments[0]->token.PrintError("range is too large");
+		return;
+	}
+
+	Value<List>* result = Helper_NewNumberList(DataType::Int, (int)count, self->arguments[0]->token);
+	int* out = result->valuePtr->ints.data();
+	for (long long i = 0; i < count; i++)
+		out[i] = (int)(first + i * step);
+
+	self->returnValue = result;
+}
+
+bool FunctionLibrary::Helper_GetText(Data* data, const char*& outText, int& outLength)
+{
+	if (data->type == DataType::String)
+	{
+		const String& str = *dynamic_cast<Value<String>*>(data)->valuePtr;
+		outText = str.data();
+		outLength = (int)str.size();
+		return true;
+	}
+
+	if (data->type != DataType::Slice)
+		return false;
+
+	Slice& slice = *dynamic_cast<Value<Slice>*>(data)->valuePtr;
+	if (slice.source->type != DataType::String)
+		return false;
+
+	outText = dynamic_cast<Value<String>*>(slice.source)->valuePtr->data() + slice.start;
+	outLength = slice.size();
+	return true;
+}
+
+Data* FunctionLibrary::Helper_PrepareChange(Data* data)
+{
+	// a slice that is changed takes its own copy first, and slices viewing a changed value copy what they see
+	if (data->type == DataType::Slice)
+	{
+		Slice& slice = *dynamic_cast<Value<Slice>*>(data)->valuePtr;
+		slice.MakeOwned();
+		data = slice.source;
+	}
+
+	Slice::DetachViews(data);
+	return data;
+}
+
+void FunctionLibrary::F_Slice(Function* self)
+{
+	if (!self->CheckArgumens(2))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+
+		int size = 0;
+	if (first->type == DataType::String)
+		size = (int)dynamic_cast<Value<String>*>(first)->valuePtr->size();
+	else if (first->type == DataType::List)
+		size = dynamic_cast<Value<List>*>(first)->valuePtr->size();
+	else if (first->type == DataType::Slice)
+		size = dynamic_cast<Value<Slice>*>(first)->valuePtr->size();
+	else
+	{
+		first->token.PrintError("expected string, list or slice");
+		return;
+	}
+
+	// negative bounds count from the end, the end bound is not included and defaults to the size
+	int bounds[2] = { 0, size };
+	for (int i = 0; i < 2 && i + 1 < (int)self->arguments.size(); i++)
+	{
+		Data* arg = self->arguments[i + 1]->Evaluate();
+		AFFIRM_DATA(arg)
+
+			if (!arg->AffirmSameType(DataType::Int))
+				return;
+
+		int bound = *dynamic_cast<Value<Int>*>(arg)->valuePtr;
+		if (bound < 0)
+			bound += size;
+
+		bounds[i] = std::max(0, std::min(bound, size));
+	}
+
+	Value<Slice>* slice = Memory<Value<Slice>>().New(DataType::Slice, false, first->token);
+	slice->Init();
+	slice->valuePtr->View(first, bounds[0], std::max(0, bounds[1] - bounds[0]));
+	self->returnValue = slice;
+}
+
+Data* FunctionLibrary::Helper_CallFunction(Value<Function>* func, Data* const* args, int argCount)
+{
+	for (int i = 0; i < argCount && i < func->valuePtr->parameterNames.size(); i++)
+	{
+		Data* argRef = nullptr;
+		args[i]->CreateSameType(argRef);
+		argRef->ReferenceOther(args[i]);
+		func->valuePtr->AddVariable(func->valuePtr->parameterNames[i], argRef);
+	}
+
+	return func->Evaluate();
+}
+
+// sorts boxed elements by a key read from each element once
+template<typename K, typename Key, typename Less>
+static void SortBoxedBy(List& l, Key key, Less less)
+{
+	std::vector<std::pair<K, Data*>> keyed;
+	keyed.reserve(l.list.size());
+	for (auto& elem : l.list)
+		keyed.push_back({ key(elem), elem });
+
+	ParallelStableSort(keyed, [&less](const std::pair<K, Data*>& a, const std::pair<K, Data*>& b) { return less(a.first, b.first); });
+
+	for (size_t i = 0; i < keyed.size(); i++)
+		l.list[i] = keyed[i].second;
+}
+
+bool FunctionLibrary::Helper_SortTyped(List& l)
+{
+	if (l.packedType == DataType::Int)
+	{
+		ParallelStableSort(l.ints, std::less<int>());
+		return true;
+	}
+	if (l.packedType == DataType::Float)
+	{
+		ParallelStableSort(l.floats, std::less<float>());
+		return true;
+	}
+	if (l.packedType == DataType::Bool)
+	{
+		ParallelStableSort(l.bools, std::less<char>());
+		return true;
+	}
+
+	if (l.list.empty())
+		return true;
+
+	DataType type = l.list[0]->type;
+	for (auto& elem : l.list)
+		if (elem->type != type)
+			return false;
+
+	switch (type)
+	{
+	case DataType::Int:
+		SortBoxedBy<Int>(l, [](Data* d) { return *dynamic_cast<Value<Int>*>(d)->valuePtr; }, std::less<Int>());
+		return true;
+	case DataType::Float:
+		SortBoxedBy<Float>(l, [](Data* d) { return *dynamic_cast<Value<Float>*>(d)->valuePtr; }, std::less<Float>());
+		return true;
+	case DataType::Bool:
+		SortBoxedBy<Bool>(l, [](Data* d) { return *dynamic_cast<Value<Bool>*>(d)->valuePtr; }, std::less<Bool>());
+		return true;
+	case DataType::String:
+		SortBoxedBy<const String*>(l, [](Data* d) { return (const String*)dynamic_cast<Value<String>*>(d)->valuePtr; }, [](const String* a, const String* b) { return *a < *b; });
+		return true;
+	default:
+		return false;
+	}
+}
+
+void FunctionLibrary::Helper_SortWithFunction(List& l, Value<Function>* less)
+{
+	// the comparison runs script code, so this sort stays on the calling thread.
+	// the order is only written back when every comparison returned a bool
+	l.Box();
+	std::vector<Data*> sorted = l.list;
+	bool failed = false;
+	std::stable_sort(sorted.begin(), sorted.end(), [less, &failed](Data* a, Data* b)
+	{
+		if (failed)
+			return false;
+
+		Data* args[2] = { a, b };
+		Data* res = Helper_CallFunction(less, args, 2);
+		if (res == nullptr || res->type != DataType::Bool)
+		{
+			less->token.PrintError("expected the function to return a bool");
+			failed = true;
+			return false;
+		}
+
+		return *dynamic_cast<Value<Bool>*>(res)->valuePtr;
+	});
+
+	if (!failed)
+		l.list = sorted;
+}
+
+Data* FunctionLibrary::Helper_GetSortedList(Function* self)
+{
+	Data* first = self->arguments[0]->Evaluate();
+	if (first == nullptr)
+		return nullptr;
+
+	// a slice sorts its own copy
+	first = Helper_PrepareChange(first);
+	if (first->type != DataType::List)
+	{
+		first->token.PrintError("expected list");
+		return nullptr;
+	}
+	if (first->isConst)
+	{
+		first->token.PrintError("tried to change const container");
+		return nullptr;
+	}
+
+	return first;
+}
+
+void FunctionLibrary::F_Sort(Function* self)
+{
+	if (!self->CheckArgumens(1))
+		return;
+
+	Data* first = Helper_GetSortedList(self);
+	AFFIRM_DATA(first)
+
+		List& l = *dynamic_cast<Value<List>*>(first)->valuePtr;
+	if (self->arguments.size() > 1)
+	{
+		Data* second = self->arguments[1]->Evaluate();
+		AFFIRM_DATA(second)
+
+			if (second->type != DataType::Function)
+			{
+				second->token.PrintError("expected a function");
+				return;
+			}
+
+		Helper_SortWithFunction(l, dynamic_cast<Value<Function>*>(second));
+	}
+	else if (!Helper_SortTyped(l))
+	{
+		first->token.PrintError("expected list of ints, floats, bools or strings");
+		return;
+	}
+
+	first->CreateSameType(self->returnValue);
+	self->returnValue->ReferenceOther(first);
+}
+
+void FunctionLibrary::F_SortBy(Function* self)
+{
+	if (!self->CheckArgumens(2))
+		return;
+
+	Data* first = Helper_GetSortedList(self);
+	AFFIRM_DATA(first)
+		Data* second = self->arguments[1]->Evaluate();
+	AFFIRM_DATA(second)
+
+		if (second->type != DataType::Function)
+		{
+			second->token.PrintError("expected a function");
+			return;
+		}
+
+	// the key function is called once per element, then the elements are sorted by their keys
+	List& l = *dynamic_cast<Value<List>*>(first)->valuePtr;
+	Value<Function>* keyFunction = dynamic_cast<Value<Function>*>(second);
+	DataType keyType = DataType::Int;
+	std::vector<Int> intKeys;
+	std::vector<Float> floatKeys;
+	std::vector<String> stringKeys;
+	for (int i = 0; i < l.size(); i++)
+	{
+		Data* elem = l.IsPacked() ? l.BoxElement(i) : l.list[i];
+		Data* key = Helper_CallFunction(keyFunction, &elem, 1);
+		if (key != nullptr && i == 0)
+			keyType = key->type;
+
+		bool valid = key != nullptr && key->type == keyType;
+		if (valid && keyType == DataType::Int)
+			intKeys.push_back(*dynamic_cast<Value<Int>*>(key)->valuePtr);
+		else if (valid && keyType == DataType::Float)
+			floatKeys.push_back(*dynamic_cast<Value<Float>*>(key)->valuePtr);
+		else if (valid && keyType == DataType::String)
+			stringKeys.push_back(*dynamic_cast<Value<String>*>(key)->valuePtr);
+		else
+			valid = false;
+
+		if (l.IsPacked())
+			FreeData(elem);
+
+		if (!valid)
+		{
+			second->token.PrintError("expected the keys to be all ints, all floats or all strings");
+			return;
+		}
+	}
+
+	std::vector<int> order(l.size());
+	for (int i = 0; i < (int)order.size(); i++)
+		order[i] = i;
+
+	if (keyType == DataType::Int)
+		ParallelStableSort(order, [&intKeys](int a, int b) { return intKeys[a] < intKeys[b]; });
+	else if (keyType == DataType::Float)
+		ParallelStableSort(order, [&floatKeys](int a, int b) { return floatKeys[a] < floatKeys[b]; });
+	else
+		ParallelStableSort(order, [&stringKeys](int a, int b) { return stringKeys[a] < stringKeys[b]; });
+
+	switch (l.packedType)
+	{
+	case DataType::Int:
+	{
+		std::vector<int> sorted(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			sorted[i] = l.ints[order[i]];
+		l.ints.swap(sorted);
+		break;
+	}
+	case DataType::Float:
+	{
+		std::vector<float> sorted(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			sorted[i] = l.floats[order[i]];
+		l.floats.swap(sorted);
+		break;
+	}
+	case DataType::Bool:
+	{
+		std::vector<char> sorted(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			sorted[i] = l.bools[order[i]];
+		l.bools.swap(sorted);
+		break;
+	}
+	default:
+	{
+		std::vector<Data*> sorted(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			sorted[i] = l.list[order[i]];
+		l.list.swap(sorted);
+		break;
+	}
+	}
+
+	first->CreateSameType(self->returnValue);
+	self->returnValue->ReferenceOther(first);
+}
+
+bool FunctionLibrary::Helper_GetSetItem(Data* data, SetItem& outItem)
+{
+	if (data->type == DataType::Int)
+	{
+		outItem = SetItem::FromInt(*dynamic_cast<Value<Int>*>(data)->valuePtr);
+		return true;
+	}
+
+	// a string slice stands for its text
+	const char* text = nullptr;
+	int length = 0;
+	if (!Helper_GetText(data, text, length))
+	{
+		data->token.PrintError("expected int or string");
+		return false;
+	}
+
+	outItem = SetItem::FromString(std::string(text, length));
+	return true;
+}
+
+Data* FunctionLibrary::Helper_NewSetItemValue(const SetItem& item, const Token& token)
+{
+	if (item.isInt)
+	{
+		Value<Int>* val = Memory<Value<Int>>().New(DataType::Int, false, token);
+		val->SetValue(item.number);
+		return val;
+	}
+
+	Value<String>* val = Memory<Value<String>>().New(DataType::String, false, token);
+	val->SetValue(item.text);
+	return val;
+}
+
+Value<Set>* FunctionLibrary::Helper_GetChangedSet(Function* self)
+{
+	if (!self->CheckArgumens(2))
+		return nullptr;
+
+	Data* first = self->arguments[0]->Evaluate();
+	if (first == nullptr || !first->AffirmSameType(DataType::Set))
+		return nullptr;
+
+	if (first->isConst)
+	{
+		first->token.PrintError("tried to change const container");
+		return nullptr;
+	}
+
+	return dynamic_cast<Value<Set>*>(first);
+}
+
+void FunctionLibrary::F_Insert(Function* self)
+{
+	Value<Set>* set = Helper_GetChangedSet(self);
+	AFFIRM_DATA(set)
+
+		bool added = false;
+	for (int i = 1; i < self->arguments.size(); i++)
+	{
+		Data* val = self->arguments[i]->Evaluate();
+		AFFIRM_DATA(val)
+
+			SetItem item;
+		if (!Helper_GetSetItem(val, item))
+			return;
+
+		added = set->valuePtr->insert(item) || added;
+	}
+
+	Value<Bool>* ret_val = Memory<Value<Bool>>().New(DataType::Bool, false, set->token);
+	ret_val->SetValue(added);
+	self->returnValue = ret_val;
+}
+
+void FunctionLibrary::F_Contains(Function* self)
+{
+	if (!self->CheckArgumens(2))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+
+		Data* second = self->arguments[1]->Evaluate();
+	AFFIRM_DATA(second)
+
+		if (!first->AffirmSameType(DataType::Set))
+			return;
+
+	SetItem item;
+	if (!Helper_GetSetItem(second, item))
+		return;
+
+	Value<Bool>* ret_val = Memory<Value<Bool>>().New(DataType::Bool, false, first->token);
+	ret_val->SetValue(dynamic_cast<Value<Set>*>(first)->valuePtr->contains(item));
+	self->returnValue = ret_val;
+}
+
+void FunctionLibrary::F_Remove(Function* self)
+{
+	Value<Set>* set = Helper_GetChangedSet(self);
+	AFFIRM_DATA(set)
+
+		bool removed = false;
+	for (int i = 1; i < self->arguments.size(); i++)
+	{
+		Data* val = self->arguments[i]->Evaluate();
+		AFFIRM_DATA(val)
+
+			SetItem item;
+		if (!Helper_GetSetItem(val, item))
+			return;
+
+		removed = set->valuePtr->remove(item) || removed;
+	}
+
+	Value<Bool>* ret_val = Memory<Value<Bool>>().New(DataType::Bool, false, set->token);
+	ret_val->SetValue(removed);
+	self->returnValue = ret_val;
+}
+
+bool FunctionLibrary::Helper_GetSets(Function* self, Value<Set>*& outFirst, Value<Set>*& outSecond)
+{
+	if (!self->CheckArgumens(2))
+		return false;
+
+	Data* first = self->arguments[0]->Evaluate();
+	if (first == nullptr)
+		return false;
+
+	Data* second = self->arguments[1]->Evaluate();
+	if (second == nullptr)
+		return false;
+
+	if (!first->AffirmSameType(DataType::Set) || !second->AffirmSameType(DataType::Set))
+		return false;
+
+	outFirst = dynamic_cast<Value<Set>*>(first);
+	outSecond = dynamic_cast<Value<Set>*>(second);
+	return true;
+}
+
+void FunctionLibrary::Helper_FilterSet(Function* self, bool keepShared)
+{
+	Value<Set>* first = nullptr;
+	Value<Set>* second = nullptr;
+	if (!Helper_GetSets(self, first, second))
+		return;
+
+	// the result keeps the order of the first set
+	Value<Set>* result = Memory<Value<Set>>().New(DataType::Set, false, first->token);
+	result->Init();
+	for (auto& item : first->valuePtr->items)
+	{
+		if (second->valuePtr->contains(item) == keepShared)
+			result->valuePtr->insert(item);
+	}
+
+	self->returnValue = result;
+}
+
+void FunctionLibrary::F_Union(Function* self)
+{
+	Value<Set>* first = nullptr;
+	Value<Set>* second = nullptr;
+	if (!Helper_GetSets(self, first, second))
+		return;
+
+	Value<Set>* result = Memory<Value<Set>>().New(DataType::Set, false, first->token);
+	result->SetValue(*first->valuePtr);
+	for (auto& item : second->valuePtr->items)
+		result->valuePtr->insert(item);
+
+	self->returnValue = result;
+}
+
+void FunctionLibrary::F_Intersect(Function* self)
+{
+	Helper_FilterSet(self, true);
+}
+
+void FunctionLibrary::F_Difference(Function* self)
+{
+	Helper_FilterSet(self, false);
+}
+
+void FunctionLibrary::Helper_AddOrderedMapEntries(Function* self, Value<OrderedMap>* map, bool copy)
+{
+	// push_copy and push_ref take key value pairs, a value already stored under a key is replaced
+	for (int i = 1; i + 1 < self->arguments.size(); i += 2)
+	{
+		Data* key = self->arguments[i]->Evaluate();
+		AFFIRM_DATA(key)
+
+			SetItem item;
+		if (!Helper_GetSetItem(key, item))
+			return;
+
+		Data* val = self->arguments[i + 1]->Evaluate();
+		AFFIRM_DATA(val)
+
+			Data* valCopy = nullptr;
+		val->CreateSameType(valCopy);
+		if (copy)
+			valCopy->CopyOther(val);
+		else
+			valCopy->ReferenceOther(val);
+
+		Data*& entry = (*map->valuePtr)[item];
+		FreeData(entry);
+		entry = valCopy;
+	}
+}
+
+Value<List>* FunctionLibrary::Helper_OrderedKeys(OrderedMap& map, const Token& token)
+{
+	Value<List>* list = Memory<Value<List>>().New(DataType::List, false, token);
+	list->Init();
+
+	// ints sort before strings, so the keys are all ints when the last one is. those go straight into a packed list
+	int lastIndex = map.size() - 1;
+	bool allInts = lastIndex < 0 || map.LeafAt(lastIndex)->keys[lastIndex].isInt;
+	if (allInts)
+		list->valuePtr->ints.reserve(map.size());
+
+	for (OrderedMapNode* leaf = map.FirstLeaf(); leaf != nullptr; leaf = leaf->next)
+	{
+		for (auto& key : leaf->keys)
+		{
+			if (allInts)
+				list->valuePtr->ints.push_back(key.number);
+			else
+				list->valuePtr->push_back(Helper_NewSetItemValue(key, token));
+		}
+	}
+
+	if (allInts)
+		list->valuePtr->packedToken = token;
+
+	return list;
+}
+
+void FunctionLibrary::Helper_Bound(Function* self, bool inclusive)
+{
+	if (!self->CheckArgumens(2))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+
+		Data* second = self->arguments[1]->Evaluate();
+	AFFIRM_DATA(second)
+
+		if (!first->AffirmSameType(DataType::OrderedMap))
+			return;
+
+	SetItem key;
+	if (!Helper_GetSetItem(second, key))
+		return;
+
+	Value<Int>* position = Memory<Value<Int>>().New(DataType::Int, false, first->token);
+	position->SetValue(dynamic_cast<Value<OrderedMap>*>(first)->valuePtr->LowerBound(key, inclusive));
+	self->returnValue = position;
+}
+
+void FunctionLibrary::F_LowerBound(Function* self)
+{
+	Helper_Bound(self, true);
+}
+
+void FunctionLibrary::F_UpperBound(Function* self)
+{
+	Helper_Bound(self, false);
+}
+
+void FunctionLibrary::Helper_EntryAt(Function* self, bool value)
+{
+	if (!self->CheckArgumens(2))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+
+		Data* second = self->arguments[1]->Evaluate();
+	AFFIRM_DATA(second)
+
+		if (!first->AffirmSameType(DataType::OrderedMap) || !second->AffirmSameType(DataType::Int))
+			return;
+
+	OrderedMap& map = *dynamic_cast<Value<OrderedMap>*>(first)->valuePtr;
+	int i = *dynamic_cast<Value<Int>*>(second)->valuePtr;
+	if (i == -1)
+		i = map.size() - 1;
+
+	if (i < 0 || i >= map.size())
+	{
+		second->token.PrintError("index out of range");
+		return;
+	}
+
+	OrderedMapNode* leaf = map.LeafAt(i);
+	if (!value)
+	{
+		self->returnValue = Helper_NewSetItemValue(leaf->keys[i], first->token);
+		return;
+	}
+
+	Data* item = leaf->values[i];
+	item->CreateSameType(self->returnValue);
+	self->returnValue->ReferenceOther(item);
+}
+
+void FunctionLibrary::F_KeyAt(Function* self)
+{
+	Helper_EntryAt(self, false);
+}
+
+void FunctionLibrary::F_ValueAt(Function* self)
+{
+	Helper_EntryAt(self, true);
+}
+
+void FunctionLibrary::Helper_EndKey(Function* self, bool last)
+{
+	if (!self->CheckArgumens(1))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+
+		if (!first->AffirmSameType(DataType::OrderedMap))
+			return;
+
+	OrderedMap& map = *dynamic_cast<Value<OrderedMap>*>(first)->valuePtr;
+	if (map.size() == 0)
+	{
+		first->token.PrintError("ordered_map is empty");
+		return;
+	}
+
+	int i = last ? map.size() - 1 : 0;
+	OrderedMapNode* leaf = map.LeafAt(i);
+	self->returnValue = Helper_NewSetItemValue(leaf->keys[i], first->token);
+}
+
+void FunctionLibrary::F_MinKey(Function* self)
+{
+	Helper_EndKey(self, false);
+}
+
+void FunctionLibrary::F_MaxKey(Function* self)
+{
+	Helper_EndKey(self, true);
+}
+
+void FunctionLibrary::F_NewObject(Function* self)
+{
+	if (!self->CheckArgumens(1))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+
+		if (!first->AffirmSameType(DataType::String))
+			return;
+
+	const NativeClass* nativeClass = NativeClass::Find(*dynamic_cast<Value<String>*>(first)->valuePtr);
+	if (nativeClass == nullptr)
+	{
+		first->token.PrintError("unknown class");
+		return;
+	}
+
+	Value<Object>* object = Memory<Value<Object>>().New(DataType::Object, false, first->token);
+	object->Init();
+	object->valuePtr->nativeClass = nativeClass;
+	object->valuePtr->state = nativeClass->NewState(first->token);
+	self->returnValue = object;
+}
+
+void FunctionLibrary::F_CallMember(Function* self)
+{
+	if (!self->CheckArgumens(2))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+		Data* second = self->arguments[1]->Evaluate();
+	AFFIRM_DATA(second)
+
+		if (!second->AffirmSameType(DataType::String))
+			return;
+
+	const std::string& name = *dynamic_cast<Value<String>*>(second)->valuePtr;
+	if (first->type == DataType::Object)
+	{
+		Object& object = *dynamic_cast<Value<Object>*>(first)->valuePtr;
+		auto itr = object.nativeClass->methods.find(name);
+		if (itr == object.nativeClass->methods.end())
+		{
+			second->token.PrintError("no such method in " + object.nativeClass->name);
+			return;
+		}
+
+		itr->second(self, object);
+		return;
+	}
+
+	if (first->type != DataType::Map)
+	{
+		first->token.PrintError("expected object or map");
+		return;
+	}
+
+	// a map object holds its methods as lambdas taking "this" as the first parameter
+	Value<Map>* map = dynamic_cast<Value<Map>*>(first);
+	if (map->valuePtr->count(name) == 0 || map->valuePtr->at(name)->type != DataType::Function)
+	{
+		second->token.PrintError("no such method");
+		return;
+	}
+
+	Value<Function>* func = dynamic_cast<Value<Function>*>(map->valuePtr->at(name));
+	for (int i = 0; i < func->valuePtr->parameterNames.size() && (i == 0 || i + 1 < self->arguments.size()); i++)
+	{
+		Data* arg = i == 0 ? first : self->arguments[i + 1]->Evaluate();
+		AFFIRM_DATA(arg)
+
+			Data* argRef = nullptr;
+		arg->CreateSameType(argRef);
+		argRef->ReferenceOther(arg);
+		func->valuePtr->AddVariable(func->valuePtr->parameterNames[i], argRef);
+	}
+
+	Data* res = func->Evaluate();
+	if (res == nullptr)
+		return;
+
+	res->CreateSameType(self->returnValue);
+	self->returnValue->ReferenceOther(res);
+}
+
+void FunctionLibrary::F_CallCPPFunction(Function* self)
+{
+	if (!self->CheckArgumens(1))
+		return;
+
+	Data* first = self->arguments[0]->Evaluate();
+	AFFIRM_DATA(first)
+
+		if (first->type != DataType::String)
+		{
+			first->token.PrintError("expected function name (string)");
+			return;
+		}
+
+	Value<String>* name = dynamic_cast<Value<String>*>(first);
+	if (Script::scriptFunctions.count(*name->valuePtr) == 0)
+	{
+		first->token.PrintError("function not defined");
+		return;
+	}
+
+	List args;
+	for (int i = 1; i < self->arguments.size(); i++)
+	{
+		Data* argRef = nullptr;
+		Data* arg = self->arguments[i]->Evaluate();
+		AFFIRM_DATA(arg)
+
+			arg->CreateSameType(argRef);
+		argRef->ReferenceOther(arg);
+		args.push_back(argRef);
+	}
+
+	Script::scriptFunctions[*name->valuePtr](args);
+}
+
+
+Script::Script()
+{
+	rootFunction = nullptr;
+	nextLexeme = 0;
+}
+
+Script::~Script()
+{
+	FreeData(rootFunction);
+
+	// a function that outlives the script (stored from a nested run) can no longer parse its body later
+	std::vector<Function*> survivors(unparsedBodies.begin(), unparsedBodies.end());
+	for (Function* function : survivors)
+		function->ParseBody();
+}
+
+std::string Script::workingDirectory;
+std::string Script::cacheDirectory;
+std::unordered_map<std::string, void(*)(List&)> Script::scriptFunctions;
+std::unordered_map<std::string, IncludedFile> Script::includeCache;
+
+bool Script::IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+bool Script::IsWhitespace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t';
+}
+
+void Script::HideStrings(SourceCode& code)
+{
+	const std::string& text = code.text;
+	std::string hiddenText;
+	hiddenText.reserve(text.size());
+	std::vector<std::pair<int, int>> anchors;
+
+	for (size_t i = 0; i < text.size();)
+	{
+		size_t skipEnd = i;
+		if (text.compare(i, 2, "/*") == 0)
+		{
+			skipEnd = text.find("*/", i + 2);
+			skipEnd = (skipEnd == std::string::npos ? text.size() : skipEnd + 2);
+		}
+		else if (text.compare(i, 2, "//") == 0 || text.compare(i, 6, "#macro") == 0)
+		{
+			skipEnd = text.find('\n', i);
+			skipEnd = (skipEnd == std::string::npos ? text.size() : skipEnd);
+		}
+		else if (text[i] == '"')
+		{
+			size_t closingQuote = text.find('"', i + 1);
+			size_t stringEnd = (closingQuote == std::string::npos ? text.size() : closingQuote);
+
+			char key[SourceCode::hiddenStringKeySize + 1];
+			snprintf(key, sizeof(key), "@%08d@", (int)code.hiddenStrings.size());
+			code.hiddenStrings.push_back(text.substr(i + 1, stringEnd - i - 1));
+			anchors.push_back({ (int)i, (int)hiddenText.size() });
+			hiddenText += key;
+
+			// a string may span lines, the lines after it still count from the file
+			i = std::min(stringEnd + 1, text.size());
+			anchors.push_back({ (int)i, (int)hiddenText.size() });
+			continue;
+		}
+
+		if (skipEnd == i)
+			skipEnd++;
+
+		hiddenText.append(text, i, skipEnd - i);
+		i = skipEnd;
+	}
+
+	code.MoveText(hiddenText, anchors);
+	code.Reset();
+}
+
+void Script::RemoveComments(SourceCode& code)
+{
+	// line comments end before the line break, a block comment without an end is left in place
+	const std::string& text = code.text;
+	std::string keptText;
+	keptText.reserve(text.size());
+	std::vector<std::pair<int, int>> anchors;
+
+	size_t copyStart = 0;
+	for (size_t i = 0; i + 1 < text.size();)
+	{
+		size_t commentEnd = std::string::npos;
+		if (text[i] == '/' && text[i + 1] == '/')
+		{
+			commentEnd = text.find_first_of("\r\n", i);
+			commentEnd = (commentEnd == std::string::npos ? text.size() : commentEnd);
+		}
+		else if (text[i] == '/' && text[i + 1] == '*')
+		{
+			commentEnd = text.find("*/", i + 2);
+			commentEnd = (commentEnd == std::string::npos ? commentEnd : commentEnd + 2);
+		}
+
+		if (commentEnd == std::string::npos)
+		{
+			i++;
+			continue;
+		}
+
+		keptText.append(text, copyStart, i - copyStart);
+		anchors.push_back({ (int)i, (int)keptText.size() });
+		anchors.push_back({ (int)commentEnd, (int)keptText.size() });
+		i = copyStart = commentEnd;
+	}
+
+	keptText.append(text, copyStart, std::string::npos);
+	code.MoveText(keptText, anchors);
+	code.Reset();
+}
+
+bool Script::PrepareIncludedFile(const std::string& path, IncludedFile& outIncludedFile)
+{
+	if (!outIncludedFile.code.ReadFile(path))
+		return false;
+
+	outIncludedFile.hash = ScriptCache::Hash(outIncludedFile.code.text);
+	HideStrings(outIncludedFile.code);
+	RemoveComments(outIncludedFile.code);
+	return true;
+}
+
+IncludedFile* Script::GetIncludedFile(const std::string& path)
+{
+	FileStamp stamp;
+	if (!GetFileStamp(path, stamp))
+		return nullptr;
+
+	auto itr = includeCache.find(path);
+	if (itr != includeCache.end() && itr->second.stamp == stamp)
+		return &itr->second;
+
+	IncludedFile& includedFile = includeCache[path];
+	includedFile.stamp = stamp;
+	if (!PrepareIncludedFile(path, includedFile))
+	{
+		includeCache.erase(path);
+		return nullptr;
+	}
+
+	return &includedFile;
+}
+
+int Script::FindIncludePath(SourceCode& code, size_t directiveIndex, std::string& outPath)
+{
+	size_t keyStart = directiveIndex + 8;
+	for (; keyStart < code.text.size() && IsWhitespace(code.text[keyStart]); keyStart++);
+
+	int pathIndex;
+	if (!code.IsHiddenString((int)keyStart, pathIndex))
+		return -1;
+
+	outPath = workingDirectory + code.hiddenStrings[pathIndex];
+	return (int)keyStart;
+}
+
+void Script::PrepareIncludes(SourceCode& code)
+{
+	// the include tree is walked one level at a time, every file of a level that is not cached yet
+	// is read and prepared on its own thread, splicing afterwards only ever hits the cache
+	std::vector<SourceCode*> level = { &code };
+	std::unordered_set<std::string> seen;
+
+	while (!level.empty())
+	{
+		std::vector<SourceCode*> nextLevel;
+		std::vector<std::pair<std::string, IncludedFile*>> jobs;
+
+		for (SourceCode* levelCode : level)
+		{
+			for (size_t i = levelCode->text.find("#include"); i != std::string::npos; i = levelCode->text.find("#include", i + 8))
+			{
+				std::string path;
+				FileStamp stamp;
+				if (FindIncludePath(*levelCode, i, path) < 0 || !seen.insert(path).second || !GetFileStamp(path, stamp))
+					continue;
+
+				auto itr = includeCache.find(path);
+				if (itr == includeCache.end() || itr->second.stamp != stamp)
+				{
+					IncludedFile& includedFile = includeCache[path];
+					includedFile.stamp = stamp;
+					jobs.push_back({ path, &includedFile });
+					nextLevel.push_back(&includedFile.code);
+				}
+				else
+					nextLevel.push_back(&itr->second.code);
+			}
+		}
+
+		std::vector<char> prepared(jobs.size(), 0);
+		std::atomic<int> nextJob(0);
+		auto worker = [&]()
+		{
+			for (int job; (job = nextJob++) < (int)jobs.size();)
+				prepared[job] = PrepareIncludedFile(jobs[job].first, *jobs[job].second);
+		};
+
+		int threadCount = std::min((int)jobs.size(), std::max(1, (int)std::thread::hardware_concurrency())) - 1;
+		std::vector<std::thread> threads;
+		for (int i = 0; i < threadCount; i++)
+			threads.emplace_back(worker);
+
+		worker();
+		for (auto& thread : threads)
+			thread.join();
+
+		// failed files are dropped, splicing reads them again and reports the error in order
+		for (int job = 0; job < (int)jobs.size(); job++)
+		{
+			if (prepared[job])
+				continue;
+
+			nextLevel.erase(std::find(nextLevel.begin(), nextLevel.end(), &jobs[job].second->code));
+			includeCache.erase(jobs[job].first);
+		}
+
+		level = std::move(nextLevel);
+	}
+}
+
+void Script::AddIncludeOrigins(SourceCode& code, size_t first, size_t last, size_t outIndex, std::vector<SourceOrigin>& outOrigins)
+{
+	// the piece of code from first to last was copied to outIndex of the spliced text, which becomes the text of sourceCode
+	SourceOrigin origin;
+	origin.index = (int)outIndex;
+	code.FindOrigin((int)first, origin.pathIndex, origin.row);
+	origin.pathIndex = sourceCode.AddOriginPath(code.OriginPath(origin.pathIndex));
+	outOrigins.push_back(origin);
+
+	for (const SourceOrigin& codeOrigin : code.origins)
+	{
+		if (codeOrigin.index <= (int)first || codeOrigin.index >= (int)last)
+			continue;
+
+		origin.index = (int)(outIndex + codeOrigin.index - first);
+		origin.pathIndex = sourceCode.AddOriginPath(code.OriginPath(codeOrigin.pathIndex));
+		origin.row = codeOrigin.row;
+		outOrigins.push_back(origin);
+	}
+}
+
+bool Script::AppendIncludes(SourceCode& code, std::string& outText, std::vector<std::string>& outHiddenStrings, std::vector<SourceOrigin>& outOrigins, std::vector<std::string>& includeStack)
+{
+	// every file numbers its strings from zero, the keys are shifted while splicing. keys keep their width,
+	// so only the pieces between directives need their origins
+	const std::string& text = code.text;
+	int stringOffset = (int)outHiddenStrings.size();
+	outHiddenStrings.insert(outHiddenStrings.end(), code.hiddenStrings.begin(), code.hiddenStrings.end());
+
+	size_t copyStart = 0;
+	size_t pieceStart = 0;
+	size_t pieceOutStart = outText.size();
+	for (size_t i = 0; i < text.size();)
+	{
+		int stringIndex;
+		if (text[i] == '@' && code.IsHiddenString((int)i, stringIndex))
+		{
+			outText.append(text, copyStart, i - copyStart);
+
+			char key[SourceCode::hiddenStringKeySize + 1];
+			snprintf(key, sizeof(key), "@%08d@", stringOffset + stringIndex);
+			outText += key;
+
+			i += SourceCode::hiddenStringKeySize;
+			copyStart = i;
+		}
+		else if (text.compare(i, 12, "#pragma once") == 0)
+		{
+			outText.append(text, copyStart, i - copyStart);
+			onceFiles.insert(code.path);
+			AddIncludeOrigins(code, pieceStart, i, pieceOutStart, outOrigins);
+
+			size_t lineEnd = text.find('\n', i);
+			i = (lineEnd == std::string::npos ? text.size() : lineEnd + 1);
+			copyStart = pieceStart = i;
+			pieceOutStart = outText.size();
+		}
+		else if (text.compare(i, 8, "#include") == 0)
+		{
+			outText.append(text, copyStart, i - copyStart);
+			AddIncludeOrigins(code, pieceStart, i, pieceOutStart, outOrigins);
+
+			std::string includeString;
+			int keyStart = FindIncludePath(code, i, includeString);
+			if (keyStart < 0)
+			{
+				code.index = (int)i + 8;
+				code.PrintErrorAtCurrentIndex("missing '\"' after #include");
+				return false;
+			}
+
+			code.index = keyStart;
+			if (std::find(includeStack.begin(), includeStack.end(), includeString) != includeStack.end())
+			{
+				code.PrintErrorAtCurrentIndex("recursive include");
+				return false;
+			}
+
+			if (onceFiles.count(includeString) == 0)
+			{
+				IncludedFile* includedFile = GetIncludedFile(includeString);
+				if (includedFile == nullptr)
+				{
+					code.PrintErrorAtCurrentIndex("failed to include file");
+					return false;
+				}
+
+				scriptCache.AddIncludedFile(includeString, includedFile->hash, includedFile->stamp);
+				includeStack.push_back(includeString);
+				if (!AppendIncludes(includedFile->code, outText, outHiddenStrings, outOrigins, includeStack))
+					return false;
+
+				includeStack.pop_back();
+			}
+
+			// the directive is dropped along with the character that follows it
+			i = std::min((size_t)keyStart + SourceCode::hiddenStringKeySize + 1, text.size());
+			copyStart = pieceStart = i;
+			pieceOutStart = outText.size();
+		}
+		else
+			i++;
+	}
+
+	outText.append(text, copyStart, std::string::npos);
+	AddIncludeOrigins(code, pieceStart, text.size(), pieceOutStart, outOrigins);
+	return true;
+}
+
+bool Script::ApplyIncludes()
+{
+	// the script is prepared like any include, but not cached since it may start after a #log_expanded line
+	std::string scriptText = sourceCode.text.substr(sourceCode.index);
+	sourceCode.MoveText(scriptText, { { sourceCode.index, 0 } });
+	sourceCode.hiddenStrings.clear();
+	HideStrings(sourceCode);
+	RemoveComments(sourceCode);
+	PrepareIncludes(sourceCode);
+
+	// included files are streamed into a fresh buffer, so every splice costs the size of the included text only
+	std::string includedText;
+	includedText.reserve(sourceCode.text.size());
+	std::vector<std::string> hiddenStrings;
+	std::vector<SourceOrigin> origins;
+	std::vector<std::string> includeStack = { sourceCode.path };
+	onceFiles.clear();
+
+	if (!AppendIncludes(sourceCode, includedText, hiddenStrings, origins, includeStack))
+		return false;
+
+	sourceCode.SetText(includedText, origins);
+	sourceCode.hiddenStrings = std::move(hiddenStrings);
+	sourceCode.Reset();
+	return true;
+}
+
+size_t Script::MatchBlock(const std::string& text, size_t first)
+{
+	// balanced run of (), [] and {} ending before the first unmatched closer, strings are skipped whole
+	std::string expectedClosers;
+	for (size_t i = first; i < text.size(); i++)
+	{
+		char c = text[i];
+		if (c == '"')
+		{
+			size_t closingQuote = text.find('"', i + 1);
+			if (closingQuote == std::string::npos)
+				return std::string::npos;
+
+			i = closingQuote;
+		}
+		else if (c == '(')
+			expectedClosers += ')';
+		else if (c == '[')
+			expectedClosers += ']';
+		else if (c == '{')
+			expectedClosers += '}';
+		else if (c == ')' || c == ']' || c == '}')
+		{
+			if (expectedClosers.size() == 0)
+				return i;
+
+			if (expectedClosers.back() != c)
+				return std::string::npos;
+
+			expectedClosers.pop_back();
+		}
+	}
+
+	return expectedClosers.size() == 0 ? text.size() : std::string::npos;
+}
+
+bool Script::MatchMacro(const Macro& macro, const std::string& text, const std::smatch& head, int groupOffset, std::vector<std::string>& outCaptures, size_t& outEnd)
+{
+	size_t start = head[groupOffset].first - text.cbegin();
+	size_t end = head[groupOffset].second - text.cbegin();
+
+	outCaptures.assign(1, "");
+	for (int i = 1; i <= macro.segmentGroupCounts[0]; i++)
+		outCaptures.push_back(head[groupOffset + i].str());
+
+	for (size_t s = 1; s < macro.segments.size(); s++)
+	{
+		size_t blockEnd = MatchBlock(text, end);
+		if (blockEnd == std::string::npos)
+			return false;
 
-			for (; sourceCode.CurrentChar() != '\n' && sourceCode.NextChar(););
+		outCaptures.push_back(text.substr(end, blockEnd - end));
+
+		std::smatch tail;
+		if (!std::regex_search(text.cbegin() + blockEnd, text.cend(), tail, macro.segments[s], std::regex_constants::match_continuous))
+			return false;
+
+		for (int i = 1; i <= macro.segmentGroupCounts[s]; i++)
+			outCaptures.push_back(tail[i].str());
+
+		end = tail[0].second - text.cbegin();
+	}
+
+	outCaptures[0] = text.substr(start, end - start);
+	outEnd = end;
+	return true;
+}
+
+void Script::SubstituteMacro(const Macro& macro, const std::vector<std::string>& captures, std::string& outText)
+{
+	const std::string& expansion = macro.expansion;
+	for (size_t i = 0; i < expansion.size(); i++)
+	{
+		char c = expansion[i];
+		if (c != '$' || i + 1 >= expansion.size())
+		{
+			outText += c;
+			continue;
+		}
+
+		char next = expansion[i + 1];
+		if (next == '$')
+		{
+			outText += '$';
+			i++;
+		}
+		else if (next == '&')
+		{
+			outText += captures[0];
+			i++;
+		}
+		else if (IsDigit(next))
+		{
+			int group = next - '0';
+			i++;
+			if (i + 1 < expansion.size() && IsDigit(expansion[i + 1]) && group * 10 + expansion[i + 1] - '0' <= macro.groupCount)
+				group = group * 10 + expansion[++i] - '0';
+
+			if (group <= macro.groupCount)
+				outText += captures[group];
+		}
+		else
+			outText += c;
+	}
+}
+
+void Script::ExpandMacro(const Macro& macro, const std::string& text, size_t first, std::string& outText, std::vector<std::pair<int, int>>* outAnchors)
+{
+	// every use of the macro from first on is rewritten once and what it is rewritten to is not scanned again.
+	// a $block capture is part of the text the macro rewrites, so uses nested in it (nested loops) are rewritten too.
+	// outAnchors, when given, gets where each use started and ended in text and in outText, see SourceCode::MoveText
+	std::smatch head;
+	size_t searchStart = first;
+
+	while (searchStart < text.size() && std::regex_search(text.cbegin() + searchStart, text.cend(), head, macro.segments[0]))
+	{
+		size_t matchStart = head[0].first - text.cbegin();
+		size_t matchEnd = 0;
+		std::vector<std::string> captures;
+		outText.append(text, searchStart, matchStart - searchStart);
+
+		// a $block that failed to balance is no use of the macro, the search goes on after its first char
+		if (!MatchMacro(macro, text, head, 0, captures, matchEnd))
+		{
+			outText += text[matchStart];
+			searchStart = matchStart + 1;
+			continue;
+		}
+
+		int captureIndex = macro.segmentGroupCounts[0];
+		for (size_t s = 1; s < macro.segments.size(); s++)
+		{
+			captureIndex++;
+			std::string block;
+			ExpandMacro(macro, captures[captureIndex], 0, block, nullptr);
+			captures[captureIndex] = std::move(block);
+			captureIndex += macro.segmentGroupCounts[s];
 		}
 
-		sourceCode.text.erase(0, sourceCode.index + 1);
+		if (outAnchors != nullptr)
+			outAnchors->push_back({ (int)matchStart, (int)outText.size() });
+
+		SubstituteMacro(macro, captures, outText);
+		if (outAnchors != nullptr)
+			outAnchors->push_back({ (int)matchEnd, (int)outText.size() });
+
+		searchStart = matchEnd;
+		if (matchEnd == matchStart)
+			outText += text[searchStart++];
+	}
+
+	if (searchStart < text.size())
+		outText.append(text, searchStart, std::string::npos);
+}
+
+bool Script::ApplyMacros()
+{
+	// each macro rewrites the text after its declaration once, in the order they are declared, so a macro sees what
+	// the ones before it made and the ones after it see what it made
+	size_t searchStart = 0;
+	while (true)
+	{
+		size_t macroStartIndex = sourceCode.text.find("#macro", searchStart);
+		if (macroStartIndex == std::string::npos)
+			break;
+
 		sourceCode.Reset();
+		sourceCode.MoveAlong((int)macroStartIndex);
+		sourceCode.MoveAlong(6);
+
+		std::string regexStr;
+		bool goNext = true;
+		char c;
+		for (; (goNext = sourceCode.NextChar()) && !IsWhitespace(c = sourceCode.CurrentChar());)
+			regexStr += c;
+
+		if (!goNext)
+		{
+			sourceCode.PrintErrorAtCurrentIndex("incomplete macro");
+			return false;
+		}
+
+		std::regex rgxName("(\\$name)");
+		std::regex rgxAny("(\\$any)");
+		regexStr = std::regex_replace(regexStr, rgxName, "[a-zA-Z_][a-zA-Z0-9_]*", std::regex_constants::format_default);
+		regexStr = std::regex_replace(regexStr, rgxAny, "[\\S\\s]*?", std::regex_constants::format_default);
+
+		std::string expansionStr;
+		for (; sourceCode.NextChar() && (c = sourceCode.CurrentChar()) != '\n';)
+			expansionStr += c;
+
+		// each ($block) splits the pattern, the pieces around it are matched as separate regexes
+		Macro macro;
+		macro.groupCount = 0;
+		for (size_t segmentStart = 0;;)
+		{
+			size_t blockIndex = regexStr.find("($block)", segmentStart);
+			macro.segmentStrs.push_back(regexStr.substr(segmentStart, blockIndex - segmentStart));
+
+			if (blockIndex == std::string::npos)
+				break;
+
+			segmentStart = blockIndex + 8;
+		}
+
+		try
+		{
+			for (auto& segmentStr : macro.segmentStrs)
+			{
+				macro.segments.push_back(std::regex(segmentStr));
+				macro.segmentGroupCounts.push_back((int)macro.segments.back().mark_count());
+				macro.groupCount += macro.segmentGroupCounts.back();
+			}
+		}
+		catch (const std::regex_error& e) {
+			sourceCode.PrintErrorAtCurrentIndex("regex: " + regexStr + " " + e.what());
+			return false;
+		}
+
+		macro.groupCount += (int)macro.segments.size() - 1;
+		macro.expansion = expansionStr;
+		macros.push_back(macro);
+
+		// the #macro line is dropped
+		size_t restStart = std::min((size_t)sourceCode.index + 1, sourceCode.text.size());
+		std::string expandedText;
+		expandedText.reserve(sourceCode.text.size());
+		expandedText.append(sourceCode.text, 0, macroStartIndex);
+		std::vector<std::pair<int, int>> anchors;
+		anchors.push_back({ (int)restStart, (int)macroStartIndex });
+
+		ExpandMacro(macros.back(), sourceCode.text, restStart, expandedText, &anchors);
+		sourceCode.MoveText(expandedText, anchors);
+		searchStart = macroStartIndex;
 	}
 
-	if (!ApplyIncludes())
-		return false;
+	sourceCode.Reset();
+	return true;
+}
 
-	HideStrings();
-	RemoveComments();
+bool Script::ApplyPreprocessing()
+{
+	scriptCache.Begin(cacheDirectory, sourceCode.path, sourceCode.text);
 
-	if (!ApplyMacros())
-		return false;
+	bool logExpanded = sourceCode.BeginsWith("#log_expanded");
+	std::string logFilename;
+	if (logExpanded)
+	{
+		sourceCode.MoveAlong(13);
+		char c;
+		for (; (c = sourceCode.CurrentChar()) != '"' && c != '\n' && sourceCode.NextChar(););
+
+		if (c == '"')
+		{
+			sourceCode.NextChar();
+			for (; (c = sourceCode.CurrentChar()) != '"' && sourceCode.NextChar();)
+				logFilename += c;
+
+			for (; sourceCode.CurrentChar() != '\n' && sourceCode.NextChar(););
+		}
+
+		// includes start copying from the cursor, so the directive line is skipped rather than erased
+		if (!sourceCode.NextChar())
+		{
+			sourceCode.text.clear();
+			sourceCode.Reset();
+		}
+	}
+
+	if (scriptCache.Load(sourceCode))
+		sourceCode.Reset();
+	else
+	{
+		if (!ApplyIncludes())
+			return false;
+
+		if (!ApplyMacros())
+			return false;
 
-	ShowStrings();
+		scriptCache.Store(sourceCode);
+	}
 
 	if (logExpanded)
 	{
+		std::string shownText = sourceCode.ShowStrings(0, (int)sourceCode.text.size() - 1);
 		if (logFilename.size() == 0)
-			printf("[INFO] preprocessed code:\n%s\n", sourceCode.text.c_str());
+			printf("[INFO] preprocessed code:\n%s\n", shownText.c_str());
 		else
 		{
 			logFilename = workingDirectory + logFilename;
 			std::ofstream logFile;
 			logFile.open(logFilename);
-			logFile << sourceCode.text;
+			logFile << shownText;
 			logFile.close();
 			printf("[INFO] preprocessed code logged to %s\n", logFilename.c_str());
 		}
 	}
 
-	std::regex newlineRgx("(\\\\n)");
-	sourceCode.text = std::regex_replace(sourceCode.text, newlineRgx, "\n", std::regex_constants::format_default);
-	std::regex tabRgx("(\\\\t)");
-	sourceCode.text = std::regex_replace(sourceCode.text, tabRgx, "\t", std::regex_constants::format_default);
 
 	sourceCode.Reset();
 	return true;
 }
 
-bool Script::RecursiveParse(Data*& outData, int maxIndex)
+void Script::SkipToClosingParenthesis(int openingLexeme)
+{
+	nextLexeme = lexer.lexemes[openingLexeme].id;
+}
+
+bool Script::ParseArguments(Function* function, int openingLexeme)
 {
-	Token unknownToken;
-	std::string unknown;
-	int lastUnknownCharIndex = 0;
+	// arguments are parsed until the matching ')' turns up, nothing is scanned twice
+	nextLexeme = openingLexeme + 1;
 
-	while (maxIndex == -1 || sourceCode.index <= maxIndex)
+	for (Data* arg = nullptr;; arg = nullptr)
 	{
-		char c = sourceCode.CurrentChar();
-		if (IsWhitespace(c));
-		else if (sourceCode.BeginsWith("/*"))
-		{
-			for (; sourceCode.NextChar() && !sourceCode.BeginsWith("*/"););
-			sourceCode.NextChar();
-		}
-		else if (sourceCode.BeginsWith("//"))
+		if (!RecursiveParse(arg))
 		{
-			for (; sourceCode.NextChar() && sourceCode.CurrentChar() != '\n';);
+			// the error is already reported, the rest of this argument list is skipped and the call fails
+			SkipToClosingParenthesis(openingLexeme);
+			return false;
 		}
-		else if (c == '"')
-		{
-			int first = sourceCode.index;
-			for (; sourceCode.NextChar() && sourceCode.CurrentChar() != '"';);
-			int last = sourceCode.index;
 
-			//Value<String>* val = new Value<String>(DataType::String, true, { sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode });
-			Value<String>* val = Memory<Value<String>>().New(DataType::String, true, Token(sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode));
-			val->SetValue(sourceCode.Substring(first + 1, last - 1));
-			sourceCode.NextChar();
+		if (arg == nullptr)
+			break;
 
-			outData = val;
-			return true;
-		}
-		else if (c == '-' || (IsDigit(c) && unknown.size() == 0))
-		{
-			bool isFloat = false;
-			std::string num;
-			num += c;
-			for (; sourceCode.NextChar(); num += c)
-			{
-				c = sourceCode.CurrentChar();
-				if (c == '.')
-				{
-					if (isFloat)
-					{
-						sourceCode.PrintErrorAtCurrentIndex("unexpected '.'");
-						return false;
-					}
-					isFloat = true;
-				}
-				else if (!IsDigit(c))
-				{
-					if (!IsDelimiter(c))
-					{
-						std::string err("unexpected '");
-						err += c;
-						err += "'";
-						sourceCode.PrintErrorAtCurrentIndex(err);
-						return false;
-					}
-					break;
-				}
-			}
+		function->AddArgument(arg);
+	}
 
-			if (isFloat)
-			{
-				//Value<Float>* val = new Value<Float>(DataType::Float, true, { sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode });
-				Value<Float>* val = Memory<Value<Float>>().New(DataType::Float, true, Token(sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode));
-				val->SetValue(std::stof(num));
-				outData = val;
-				return true;
-			}
-			else
-			{
-				//Value<Int>* val = new Value<Int>(DataType::Int, true, { sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode });
-				Value<Int>* val = Memory<Value<Int>>().New(DataType::Int, true, Token(sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode));
-				val->SetValue(std::stoi(num));
-				outData = val;
-				return true;
-			}
-		}
-		else if (sourceCode.BeginsWith("true"))
-		{
-			//Value<Bool>* val = new Value<Bool>(DataType::Bool, true, { sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode });
-			Value<Bool>* val = Memory<Value<Bool>>().New(DataType::Bool, true, Token(sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode));
-			val->SetValue(true);
-			sourceCode.MoveAlong(4);
-			outData = val;
-			return true;
-		}
-		else if (sourceCode.BeginsWith("false"))
+	if (lexer.lexemes[nextLexeme].type == LexemeType::End)
+	{
+		sourceCode.PrintError(Token(lexer.lexemes[openingLexeme].index, sourceCode.id), "expected ')' missing");
+		return false;
+	}
+
+	return true;
+}
+
+bool Script::ParseFunctionBody(Function* function)
+{
+	int resumeLexeme = nextLexeme;
+	int openingLexeme = function->bodyOpeningLexeme;
+	function->bodyScript = nullptr;
+	unparsedBodies.erase(function);
+
+	bool parsed = ParseArguments(function, openingLexeme);
+	nextLexeme = resumeLexeme;
+	return parsed;
+}
+
+bool Script::RecursiveParse(Data*& outData)
+{
+	const Lexeme& lexeme = lexer.lexemes[nextLexeme];
+	Token token(lexeme.index, sourceCode.id);
+
+	switch (lexeme.type)
+	{
+	case LexemeType::End:
+	case LexemeType::ClosingParenthesis:
+		return true;
+
+	case LexemeType::String:
+	{
+		Value<String>* val = Memory<Value<String>>().New(DataType::String, true, token);
+		val->SetValue(lexer.strings[lexeme.id].Text());
+		outData = val;
+		break;
+	}
+	case LexemeType::Int:
+	{
+		Value<Int>* val = Memory<Value<Int>>().New(DataType::Int, true, token);
+		val->SetValue(lexeme.intValue);
+		outData = val;
+		break;
+	}
+	case LexemeType::Float:
+	{
+		Value<Float>* val = Memory<Value<Float>>().New(DataType::Float, true, token);
+		val->SetValue(lexeme.floatValue);
+		outData = val;
+		break;
+	}
+	case LexemeType::True:
+	case LexemeType::False:
+	{
+		Value<Bool>* val = Memory<Value<Bool>>().New(DataType::Bool, true, token);
+		val->SetValue(lexeme.type == LexemeType::True);
+		outData = val;
+		break;
+	}
+	case LexemeType::List:
+	{
+		Value<List>* val = Memory<Value<List>>().New(DataType::List, true, token);
+		val->SetValue({});
+		outData = val;
+		break;
+	}
+	case LexemeType::Map:
+	{
+		Value<Map>* val = Memory<Value<Map>>().New(DataType::Map, true, token);
+		val->SetValue({});
+		outData = val;
+		break;
+	}
+	case LexemeType::Deque:
+	{
+		Value<Deque>* val = Memory<Value<Deque>>().New(DataType::Deque, true, token);
+		val->SetValue({});
+		outData = val;
+		break;
+	}
+	case LexemeType::Set:
+	{
+		Value<Set>* val = Memory<Value<Set>>().New(DataType::Set, true, token);
+		val->SetValue({});
+		outData = val;
+		break;
+	}
+	case LexemeType::OrderedMap:
+	{
+		Value<OrderedMap>* val = Memory<Value<OrderedMap>>().New(DataType::OrderedMap, true, token);
+		val->Init();
+		outData = val;
+		break;
+	}
+	case LexemeType::OpeningParenthesis:
+	{
+		sourceCode.PrintError(token, "unexpected '('");
+		return false;
+	}
+	case LexemeType::Name:
+	{
+		const Lexeme& opening = lexer.lexemes[nextLexeme + 1];
+		if (opening.type == LexemeType::Name)
 		{
-			//Value<Bool>* val = new Value<Bool>(DataType::Bool, true, { sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode });
-			Value<Bool>* val = Memory<Value<Bool>>().New(DataType::Bool, true, Token(sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode));
-			val->SetValue(false);
-			sourceCode.MoveAlong(5);
-			outData = val;
-			return true;
+			sourceCode.PrintError(token, "unexpected " + lexer.names[lexeme.id].Text());
+			return false;
 		}
-		else if (sourceCode.BeginsWith("list"))
+
+		// a name that is not called is skipped, scripts use this for separators like "key" : value
+		if (opening.type != LexemeType::OpeningParenthesis)
 		{
-			//Value<List>* val = new Value<List>(DataType::List, true, { sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode });
-			Value<List>* val = Memory<Value<List>>().New(DataType::List, true, Token(sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode));
-			val->SetValue({});
-			sourceCode.MoveAlong(4);
-			outData = val;
-			return true;
+			nextLexeme++;
+			return RecursiveParse(outData);
 		}
-		else if (sourceCode.BeginsWith("map"))
+
+		if (nameFunctions[lexeme.id] == nullptr)
 		{
-			//Value<Map>* val = new Value<Map>(DataType::Map, true, { sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode });
-			Value<Map>* val = Memory<Value<Map>>().New(DataType::Map, true, Token(sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode));
-			val->SetValue({});
-			sourceCode.MoveAlong(3);
-			outData = val;
-			return true;
+			sourceCode.PrintError(token, "undefined '" + lexer.names[lexeme.id].Text() + "'");
+			return false;
 		}
-		else if (unknown.size() > 0 && IsDelimiter(c))
-		{
-			if (functionLibrary.functions.count(unknown) == 0)
-			{
-				sourceCode.PrintError(unknownToken, "undefined '" + unknown + "'");
-				return false;
-			}
 
-			//Value<Function>* val = new Value<Function>(DataType::Function, true, unknownToken);
-			Value<Function>* val = Memory<Value<Function>>().New(DataType::Function, true, unknownToken);
-			val->SetValue(functionLibrary.functions[unknown]);
+		Value<Function>* val = Memory<Value<Function>>().New(DataType::Function, true, token);
+		val->SetValue(nameFunctions[lexeme.id]);
 
-			for (; c != '(' && sourceCode.NextChar() && IsWhitespace(c = sourceCode.CurrentChar()););
-			if (c != '(')
-			{
-				std::string err = "unexpected '";
-				err += c;
-				err += "'";
-				sourceCode.PrintErrorAtCurrentIndex(err);
-				return false;
-			}
+		int openingLexeme = nextLexeme + 1;
 
-			int opened = 0;
-			int closingIndex = sourceCode.index;
-			for (int i = sourceCode.index; i < sourceCode.text.size(); i++, closingIndex++)
-			{
-				if ((c = sourceCode.text[i]) == '(')
-					opened++;
-				else if (c == ')' && --opened == 0)
-					break;
-			}
-			if (opened == 1)
-			{
-				sourceCode.PrintErrorAtCurrentIndex("expected ')' missing");
-				return false;
-			}
+		// function bodies are only parsed once they are first called, see ParseFunctionBody
+		if (nameFunctions[lexeme.id] == FunctionLibrary::F_Function && lexer.lexemes[opening.id].type != LexemeType::End)
+		{
+			val->valuePtr->bodyScript = this;
+			val->valuePtr->bodyOpeningLexeme = openingLexeme;
+			unparsedBodies.insert(val->valuePtr);
+			nextLexeme = opening.id;
+		}
+		else if (!ParseArguments(val->valuePtr, openingLexeme))
+			return false;
 
-			if (sourceCode.index + 1 < closingIndex)
-			{
-				Data* arg = nullptr;
-				sourceCode.NextChar();
-				for (; RecursiveParse(arg, closingIndex - 1) && arg != nullptr;)
-				{
-					val->valuePtr->AddArgument(arg);
-					arg = nullptr;
-				}
-			}
+		outData = val;
+		break;
+	}
+	}
 
-			sourceCode.NextChar();
+	nextLexeme++;
+	return true;
+}
 
-			outData = val;
-			return true;
-		}
-		else
-		{
-			if (unknown.size() == 0)
-				unknownToken = { sourceCode.row, sourceCode.col, sourceCode.index, &sourceCode };
-			else if (sourceCode.index > lastUnknownCharIndex + 1)
-			{
-				sourceCode.PrintError(unknownToken, "unexpected " + unknown);
-				return false;
-			}
+bool Script::LoadScript(const std::string& path)
+{
+	// stamps are taken before reading, so a file that changes while loading is seen as changed afterwards
+	FileStamp stamp = { -1, -1 };
+	GetFileStamp(workingDirectory + path, stamp);
 
-			lastUnknownCharIndex = sourceCode.index;
-			unknown += c;
-		}
+	loadedPath = path;
+	bool loaded = ParseScript(path);
 
+	loadedFiles.clear();
+	loadedFiles.push_back({ workingDirectory + path, stamp });
+	for (const CachedFile& file : scriptCache.includedFiles)
+		loadedFiles.push_back({ file.path, file.stamp });
 
-		if (!sourceCode.NextChar())
-			break;
+	return loaded;
+}
+
+bool Script::FilesChanged()
+{
+	for (auto& loadedFile : loadedFiles)
+	{
+		FileStamp stamp = { -1, -1 };
+		GetFileStamp(loadedFile.first, stamp);
+		if (stamp != loadedFile.second)
+			return true;
 	}
 
-	return true;
+	return false;
 }
 
-bool Script::LoadScript(const std::string& path)
+bool Script::ParseScript(const std::string& path)
 {
+	// precompiled scripts skip reading, preprocessing and parsing altogether
+	static const std::string imageExtension = ".funkyc";
+	if (path.size() > imageExtension.size() && path.compare(path.size() - imageExtension.size(), std::string::npos, imageExtension) == 0)
+		return LoadImage(workingDirectory + path);
+
 	if (!sourceCode.ReadFile(workingDirectory + path))
 		return false;
 
 	if (!ApplyPreprocessing())
 		return false;
 
+	if (!lexer.Tokenize(sourceCode))
+		return false;
+
+	// every distinct name is looked up in the library once, not once per call site
+	nameFunctions.resize(lexer.names.size());
+	for (int i = 0; i < lexer.names.size(); i++)
+	{
+		auto itr = functionLibrary.functions.find(lexer.names[i].Text());
+		nameFunctions[i] = (itr == functionLibrary.functions.end() ? nullptr : itr->second);
+	}
+
+	nextLexeme = 0;
+
 	Data* res = nullptr;
-	if (!RecursiveParse(res) || !res->AffirmSameType(DataType::Function))
+	if (!RecursiveParse(res))
+		return false;
+
+	if (res == nullptr)
+	{
+		const Lexeme& lexeme = lexer.lexemes[nextLexeme];
+		sourceCode.PrintError(Token(lexeme.index, sourceCode.id), "expected function");
+		return false;
+	}
+
+	if (!res->AffirmSameType(DataType::Function))
 		return false;
 
 	rootFunction = dynamic_cast<Value<Function>*>(res);
@@ -1960,5 +4080,57 @@ bool Script::LoadScript(const std::string& path)
 
 void Script::Run()
 {
-	rootFunction->valuePtr->Call();
+	// the root scope is kept after running, Reload swaps definitions into it and CallDefinition calls them
+	rootFunction->valuePtr->FreeVariables();
+	rootFunction->valuePtr->CallAndKeepVariables();
+}
+
+bool Script::Reload()
+{
+	// the changed files are parsed again as a new script, unchanged includes come prepared from includeCache.
+	// its top-level defs replace the ones in the root scope of this script and see the variables there. nothing
+	// else in it runs, so state built by the first run is kept and a def that was removed keeps its old binding
+	if (!FilesChanged())
+		return true;
+
+	std::unique_ptr<Script> next(new Script());
+	bool loaded = next->LoadScript(loadedPath);
+
+	// a broken edit is reported once, not on every poll until it is fixed
+	loadedFiles = next->loadedFiles;
+	if (!loaded || !next->rootFunction->valuePtr->ParseBody())
+		return false;
+
+	Function* root = rootFunction->valuePtr;
+	for (Data* statement : next->rootFunction->valuePtr->arguments)
+	{
+		if (statement->type != DataType::Function)
+			continue;
+
+		Function* definition = dynamic_cast<Value<Function>*>(statement)->valuePtr;
+		if (definition->function != FunctionLibrary::F_DefineFunction || definition->arguments.empty())
+			continue;
+
+		Data* name = definition->arguments[0]->Evaluate();
+		if (name == nullptr || name->type != DataType::String)
+			continue;
+
+		root->RemoveVariable(FunctionLibrary::Helper_GetName(definition, dynamic_cast<Value<String>*>(name)));
+		definition->parent = root;
+		statement->Evaluate();
+	}
+
+	reloads.push_back(std::move(next));
+	return true;
+}
+
+bool Script::CallDefinition(const std::string& name)
+{
+	// a function defined at the top level of the script, called without arguments
+	Data* definition = nullptr;
+	if (rootFunction == nullptr || !rootFunction->valuePtr->GetVariable(VariableName(name), definition) || definition->type != DataType::Function)
+		return false;
+
+	definition->Evaluate();
+	return true;
 }
@@ -1,7 +1,26 @@
 #pragma once
 #include "source_code.h"
+#include "lexer.h"
+#include "script_cache.h"
+#include "mapped_file.h"
 #include "value.h"
 #include "value_types.h"
+#include "simd.h"
+#include "native_classes.h"
+#include <regex>
+#include <unordered_set>
+#include <memory>
+
+// the values of an int or float list, pointing straight into a packed list or into copies taken from a boxed one
+struct NumberList
+{
+	DataType type;
+	int count;
+	const int* ints;
+	const float* floats;
+	std::vector<int> intCopies;
+	std::vector<float> floatCopies;
+};
 
 struct FunctionLibrary
 {
@@ -17,18 +36,30 @@ struct FunctionLibrary
 	static void Helper_PrintString(Data* data);
 	static void Helper_PrintList(Data* data);
 	static void Helper_PrintMap(Data* data);
+	static void Helper_PrintDeque(Data* data);
 	static void Helper_PrintFunction(Data* data);
+	static void Helper_PrintObject(Data* data);
+	static void Helper_PrintSlice(Data* data);
+	static void Helper_PrintSet(Data* data);
+	static void Helper_PrintOrderedMap(Data* data);
 	static void Helper_PrintAny(Data* d);
 	static void F_Print(Function* self);
 	static void F_Input(Function* self);
 	static void F_ReturnCopy(Function* self);
 	static void F_ReturnReference(Function* self);
+	static VariableName Helper_GetName(Function* self, Value<String>* name);
+	static bool Helper_AppendInPlace(Function* self, const VariableName& name);
 	static void F_SetCopy(Function* self);
 	static void F_SetReference(Function* self);
 	static void F_AddElementsAsCopies(Function* self);
 	static void F_AddElementsAsReferences(Function* self);
 	static void F_GetElement(Function* self);
+	static Data* Helper_ReadValue(Data* arg);
+	static void Helper_GetElement(Function* self, bool reference);
 	static void F_RemoveElement(Function* self);
+	static void Helper_PopElement(Function* self, bool front);
+	static void F_PopFront(Function* self);
+	static void F_PopBack(Function* self);
 	static void F_HasKey(Function* self);
 	static void F_DefineFunction(Function* self);
 	static void F_GetVariable(Function* self);
@@ -38,6 +69,7 @@ struct FunctionLibrary
 	static void F_If(Function* self);
 	static void F_While(Function* self);
 	static void F_TypeOf(Function* self);
+	static bool Helper_ToString(Data* data, std::string& outStr);
 	static void F_ToString(Function* self);
 	static bool Helper_IsInt(const std::string& str);
 	static bool Helper_IsFloat(const std::string& str);
@@ -54,43 +86,160 @@ struct FunctionLibrary
 	static void F_Not(Function* self);
 	static void F_Count(Function* self);
 	static void F_Keys(Function* self);
+	static bool Helper_GetText(Data* data, const char*& outText, int& outLength);
+	static Data* Helper_PrepareChange(Data* data);
+	static void F_Slice(Function* self);
+	static Data* Helper_CallFunction(Value<Function>* func, Data* const* args, int argCount);
+	static bool Helper_SortTyped(List& l);
+	static void Helper_SortWithFunction(List& l, Value<Function>* less);
+	static Data* Helper_GetSortedList(Function* self);
+	static void F_Sort(Function* self);
+	static void F_SortBy(Function* self);
+	static bool Helper_GetSetItem(Data* data, SetItem& outItem);
+	static Data* Helper_NewSetItemValue(const SetItem& item, const Token& token);
+	static Value<Set>* Helper_GetChangedSet(Function* self);
+	static void F_Insert(Function* self);
+	static void F_Contains(Function* self);
+	static void F_Remove(Function* self);
+	static bool Helper_GetSets(Function* self, Value<Set>*& outFirst, Value<Set>*& outSecond);
+	static void Helper_FilterSet(Function* self, bool keepShared);
+	static void F_Union(Function* self);
+	static void F_Intersect(Function* self);
+	static void F_Difference(Function* self);
+	static void Helper_AddOrderedMapEntries(Function* self, Value<OrderedMap>* map, bool copy);
+	static Value<List>* Helper_OrderedKeys(OrderedMap& map, const Token& token);
+	static void Helper_Bound(Function* self, bool inclusive);
+	static void F_LowerBound(Function* self);
+	static void F_UpperBound(Function* self);
+	static void Helper_EntryAt(Function* self, bool value);
+	static void F_KeyAt(Function* self);
+	static void F_ValueAt(Function* self);
+	static void Helper_EndKey(Function* self, bool last);
+	static void F_MinKey(Function* self);
+	static void F_MaxKey(Function* self);
+	static bool Helper_GetNumbers(Data* data, NumberList& outNumbers);
+	static Value<List>* Helper_NewNumberList(DataType type, int count, const Token& token);
+	static void Helper_Elementwise(Function* self, void(*intOp)(const int*, const int*, int*, int), void(*floatOp)(const float*, const float*, float*, int));
+	static void F_Sum(Function* self);
+	static void F_Min(Function* self);
+	static void F_Max(Function* self);
+	static void F_Dot(Function* self);
+	static void F_VAdd(Function* self);
+	static void F_VSub(Function* self);
+	static void F_VMul(Function* self);
+	static void F_VScale(Function* self);
+	static void F_Fill(Function* self);
+	static void F_Range(Function* self);
+	static void F_NewObject(Function* self);
+	static void F_CallMember(Function* self);
 	static void F_CallCPPFunction(Function* self);
 };
 
+struct Macro
+{
+	std::vector<std::string> segmentStrs;
+	std::vector<std::regex> segments;
+	std::vector<int> segmentGroupCounts;
+	std::string expansion;
+	int groupCount;
+};
+
+// an included file with its strings hidden (numbered from zero) and comments removed
+struct IncludedFile
+{
+	SourceCode code;
+	unsigned long long hash;
+	FileStamp stamp;
+};
+
 struct Script
 {
 	static std::string workingDirectory;
+	// preprocessed scripts are cached in this directory (see ScriptCache), the cache is off while it is empty
+	static std::string cacheDirectory;
 	static std::unordered_map<std::string, void(*)(List&)> scriptFunctions;
+	// shared by every script in the process, entries are re-read once the file on disk changes
+	static std::unordered_map<std::string, IncludedFile> includeCache;
 
 	SourceCode sourceCode;
-	int nextHiddenStringIndex = 0;
-	std::unordered_map<std::string, std::string> hiddenStrings;
+	ScriptCache scriptCache;
+	// the path given to LoadScript, relative to workingDirectory
+	std::string loadedPath;
+	std::unordered_set<std::string> onceFiles;
+	// the script and everything it included, as they were when it was loaded
+	std::vector<std::pair<std::string, FileStamp>> loadedFiles;
+	std::vector<Macro> macros;
 	FunctionLibrary functionLibrary;
+	Lexer lexer;
+	std::vector<void(*)(Function*)> nameFunctions;
+	int nextLexeme;
+	// functions whose bodies are still unparsed, the ones still alive when the script goes are parsed then
+	std::unordered_set<Function*> unparsedBodies;
 	Value<Function>* rootFunction;
+	// the scripts parsed by Reload, the definitions taken from them live in their trees
+	std::vector<std::unique_ptr<Script>> reloads;
 
 	Script();
+	Script(const Script&) = delete;
+	Script& operator=(const Script&) = delete;
+	~Script();
 
 	bool IsDigit(char c);
 
 	bool IsWhitespace(char c);
 
-	bool IsDelimiter(char c);
+	void HideStrings(SourceCode& code);
+
+	void RemoveComments(SourceCode& code);
+
+	bool PrepareIncludedFile(const std::string& path, IncludedFile& outIncludedFile);
+
+	IncludedFile* GetIncludedFile(const std::string& path);
+
+	int FindIncludePath(SourceCode& code, size_t directiveIndex, std::string& outPath);
+
+	void PrepareIncludes(SourceCode& code);
+
+	void AddIncludeOrigins(SourceCode& code, size_t first, size_t last, size_t outIndex, std::vector<SourceOrigin>& outOrigins);
+	bool AppendIncludes(SourceCode& code, std::string& outText, std::vector<std::string>& outHiddenStrings, std::vector<SourceOrigin>& outOrigins, std::vector<std::string>& includeStack);
 
 	bool ApplyIncludes();
 
-	void HideStrings();
+	size_t MatchBlock(const std::string& text, size_t first);
 
-	void RemoveComments();
+	bool MatchMacro(const Macro& macro, const std::string& text, const std::smatch& head, int groupOffset, std::vector<std::string>& outCaptures, size_t& outEnd);
 
-	bool ApplyMacros();
+	void SubstituteMacro(const Macro& macro, const std::vector<std::string>& captures, std::string& outText);
+
+	void ExpandMacro(const Macro& macro, const std::string& text, size_t first, std::string& outText, std::vector<std::pair<int, int>>* outAnchors);
 
-	void ShowStrings();
+	bool ApplyMacros();
 
 	bool ApplyPreprocessing();
 
-	bool RecursiveParse(Data*& outData, int maxIndex = -1);
+	void SkipToClosingParenthesis(int openingLexeme);
+
+	bool ParseArguments(Function* function, int openingLexeme);
+
+	bool ParseFunctionBody(Function* function);
+
+	bool RecursiveParse(Data*& outData);
 
 	bool LoadScript(const std::string& path);
 
+	bool FilesChanged();
+
+	bool ParseScript(const std::string& path);
+
+	bool SaveImage(const std::string& path);
+
+	bool ReadImageNode(const struct ImageNode* nodes, unsigned int nodeCount, unsigned int& nextNode, Data*& outData);
+
+	bool LoadImage(const std::string& path);
+
 	void Run();
+
+	bool Reload();
+
+	bool CallDefinition(const std::string& name);
 };
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "script_cache.h"
+#include "mapped_file.h"
+#include <fstream>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static void MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+static std::string TempPath(const std::string& path)
+{
+	// every write gets its own name, so processes and threads storing the same entry do not write into one file
+	static std::atomic<unsigned> writes(0);
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = (int)getpid();
+#endif
+	char suffix[48];
+	snprintf(suffix, sizeof(suffix), ".%d.%u.tmp", pid, writes++);
+	return path + suffix;
+}
+
+static bool ReadWholeFile(const std::string& path, std::string& outText, bool asText)
+{
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	if (asText)
+		file.CopyText(outText);
+	else
+		outText.assign(file.data, file.size);
+
+	return true;
+}
+
+static void WriteUInt64(std::string& out, unsigned long long value)
+{
+	out.append((const char*)&value, sizeof(value));
+}
+
+static void WriteString(std::string& out, const std::string& str)
+{
+	WriteUInt64(out, str.size());
+	out += str;
+}
+
+static bool ReadUInt64(const std::string& in, size_t& cursor, unsigned long long& outValue)
+{
+	if (cursor + sizeof(outValue) > in.size())
+		return false;
+
+	memcpy(&outValue, in.data() + cursor, sizeof(outValue));
+	cursor += sizeof(outValue);
+	return true;
+}
+
+static bool ReadString(const std::string& in, size_t& cursor, std::string& outStr)
+{
+	unsigned long long size;
+	if (!ReadUInt64(in, cursor, size) || size > in.size() - cursor)
+		return false;
+
+	outStr.assign(in, cursor, (size_t)size);
+	cursor += (size_t)size;
+	return true;
+}
+
+ScriptCache::ScriptCache()
+{
+	sourceHash = 0;
+}
+
+unsigned long long ScriptCache::Hash(const std::string& text, unsigned long long hash)
+{
+	// 64 bit FNV-1a, hash is the offset basis or the hash of text that came before
+	for (unsigned char c : text)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+void ScriptCache::Begin(const std::string& _directory, const std::string& path, const std::string& sourceText)
+{
+	// includes are found relative to the script, so the same text at another path may preprocess differently
+	directory = _directory;
+	sourcePath = path;
+	sourceHash = Hash(sourceText, Hash(path));
+	includedFiles.clear();
+}
+
+void ScriptCache::AddIncludedFile(const std::string& path, unsigned long long hash, const FileStamp& stamp)
+{
+	includedFiles.push_back({ path, hash, stamp });
+}
+
+std::string ScriptCache::EntryPath()
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.fpp", sourceHash);
+	return directory + name;
+}
+
+bool ScriptCache::Load(SourceCode& outCode)
+{
+	std::string entry;
+	if (directory.empty() || !ReadWholeFile(EntryPath(), entry, false))
+		return false;
+
+	size_t cursor = 0;
+	unsigned long long version, storedSourceHash, includedFileCount, hiddenStringCount;
+	if (!ReadUInt64(entry, cursor, version) || version != formatVersion)
+		return false;
+
+	if (!ReadUInt64(entry, cursor, storedSourceHash) || storedSourceHash != sourceHash)
+		return false;
+
+	std::string storedPath;
+	if (!ReadString(entry, cursor, storedPath) || storedPath != sourcePath)
+		return false;
+
+	if (!ReadUInt64(entry, cursor, includedFileCount))
+		return false;
+
+	std::vector<CachedFile> storedFiles(includedFileCount < 4096 ? (size_t)includedFileCount : 0);
+	if (storedFiles.size() != includedFileCount)
+		return false;
+
+	for (CachedFile& file : storedFiles)
+	{
+		if (!ReadString(entry, cursor, file.path) || !ReadUInt64(entry, cursor, file.hash))
+			return false;
+
+		// an include that changed or went missing makes the whole entry stale
+		std::string text;
+		if (!GetFileStamp(file.path, file.stamp) || !ReadWholeFile(file.path, text, true) || Hash(text) != file.hash)
+			return false;
+	}
+
+	if (!ReadUInt64(entry, cursor, hiddenStringCount) || hiddenStringCount > entry.size())
+		return false;
+
+	std::vector<std::string> hiddenStrings((size_t)hiddenStringCount);
+	for (std::string& str : hiddenStrings)
+		if (!ReadString(entry, cursor, str))
+			return false;
+
+	unsigned long long originPathCount, originCount;
+	if (!ReadUInt64(entry, cursor, originPathCount) || originPathCount > entry.size())
+		return false;
+
+	std::vector<std::string> originPaths((size_t)originPathCount);
+	for (std::string& originPath : originPaths)
+		if (!ReadString(entry, cursor, originPath))
+			return false;
+
+	if (!ReadUInt64(entry, cursor, originCount) || originCount > entry.size())
+		return false;
+
+	std::vector<SourceOrigin> origins((size_t)originCount);
+	for (SourceOrigin& origin : origins)
+	{
+		unsigned long long index, pathIndex, row;
+		if (!ReadUInt64(entry, cursor, index) || !ReadUInt64(entry, cursor, pathIndex) || !ReadUInt64(entry, cursor, row))
+			return false;
+
+		origin.index = (int)index;
+		origin.pathIndex = (int)(long long)pathIndex;
+		origin.row = (int)row;
+		if (origin.pathIndex >= (int)originPaths.size())
+			return false;
+	}
+
+	std::string text;
+	if (!ReadString(entry, cursor, text))
+		return false;
+
+	includedFiles = std::move(storedFiles);
+	outCode.hiddenStrings = std::move(hiddenStrings);
+	outCode.text = std::move(text);
+	outCode.originPaths = std::move(originPaths);
+	outCode.origins = std::move(origins);
+	outCode.lineStarts.clear();
+	return true;
+}
+
+void ScriptCache::Store(const SourceCode& code)
+{
+	if (directory.empty())
+		return;
+
+	std::string entry;
+	entry.reserve(code.text.size() + 1024);
+	WriteUInt64(entry, formatVersion);
+	WriteUInt64(entry, sourceHash);
+	WriteString(entry, sourcePath);
+
+	WriteUInt64(entry, includedFiles.size());
+	for (const CachedFile& file : includedFiles)
+	{
+		WriteString(entry, file.path);
+		WriteUInt64(entry, file.hash);
+	}
+
+	WriteUInt64(entry, code.hiddenStrings.size());
+	for (const std::string& str : code.hiddenStrings)
+		WriteString(entry, str);
+
+	WriteUInt64(entry, code.originPaths.size());
+	for (const std::string& originPath : code.originPaths)
+		WriteString(entry, originPath);
+
+	WriteUInt64(entry, code.origins.size());
+	for (const SourceOrigin& origin : code.origins)
+	{
+		WriteUInt64(entry, (unsigned long long)origin.index);
+		WriteUInt64(entry, (unsigned long long)(long long)origin.pathIndex);
+		WriteUInt64(entry, (unsigned long long)origin.row);
+	}
+
+	WriteString(entry, code.text);
+
+	MakeDirectory(directory);
+
+	// written next to the entry and renamed over it, so a concurrent load never sees half a file
+	std::string entryPath = EntryPath();
+	std::string tempPath = TempPath(entryPath);
+	std::ofstream file;
+	file.open(tempPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return;
+
+	file.write(entry.data(), entry.size());
+	file.close();
+	if (file.fail())
+	{
+		remove(tempPath.c_str());
+		return;
+	}
+
+#ifdef _WIN32
+	remove(entryPath.c_str());
+#endif
+	rename(tempPath.c_str(), entryPath.c_str());
+}
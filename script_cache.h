@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "source_code.h"
+
+struct CachedFile
+{
+	std::string path;
+	unsigned long long hash;
+	// taken before the file was read, not stored in the cache entry
+	FileStamp stamp;
+};
+
+// preprocessed scripts are stored in directory (Script::cacheDirectory), keyed by a hash of the script path and text,
+// an entry is only used while every file it included still hashes the same. nothing is read or written while
+// directory is empty, the included files are still recorded for Script::FilesChanged
+struct ScriptCache
+{
+	std::string directory;
+	std::string sourcePath;
+	unsigned long long sourceHash;
+	std::vector<CachedFile> includedFiles;
+
+	// bump whenever the preprocessor output or the entry layout changes for the same input
+	static const int formatVersion = 4;
+
+	ScriptCache();
+
+	static unsigned long long Hash(const std::string& text, unsigned long long hash = 14695981039346656037ull);
+
+	void Begin(const std::string& _directory, const std::string& path, const std::string& sourceText);
+
+	void AddIncludedFile(const std::string& path, unsigned long long hash, const FileStamp& stamp);
+
+	std::string EntryPath();
+
+	bool Load(SourceCode& outCode);
+
+	void Store(const SourceCode& code);
+};
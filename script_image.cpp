@@ -0,0 +1,405 @@
+#include "script.h"
+#include "script_image.h"
+#include "mapped_file.h"
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+
+struct ImageWriter
+{
+	std::vector<ImageNode> nodes;
+	std::vector<ImageString> names;
+	std::vector<ImageString> strings;
+	std::vector<ImageString> hiddenStrings;
+	std::vector<ImageString> originPaths;
+	std::unordered_map<std::string, unsigned int> nameIds;
+	std::unordered_map<std::string, unsigned int> stringIds;
+	std::unordered_map<void(*)(Function*), std::string> functionNames;
+	std::string blob;
+
+	ImageString AddToBlob(const std::string& str)
+	{
+		ImageString imageString = { (unsigned int)blob.size(), (unsigned int)str.size() };
+		blob += str;
+		return imageString;
+	}
+
+	unsigned int Intern(std::vector<ImageString>& table, std::unordered_map<std::string, unsigned int>& ids, const std::string& str)
+	{
+		auto itr = ids.find(str);
+		if (itr != ids.end())
+			return itr->second;
+
+		unsigned int id = (unsigned int)table.size();
+		table.push_back(AddToBlob(str));
+		ids[str] = id;
+		return id;
+	}
+
+	bool WriteNode(Data* data)
+	{
+		ImageNode node = {};
+		node.type = (unsigned char)data->type;
+		node.index = data->token.index;
+
+		switch (data->type)
+		{
+		case DataType::Bool:
+			node.value = (*dynamic_cast<Value<Bool>*>(data)->valuePtr ? 1 : 0);
+			break;
+		case DataType::Int:
+			node.value = (unsigned int)*dynamic_cast<Value<Int>*>(data)->valuePtr;
+			break;
+		case DataType::Float:
+			memcpy(&node.value, dynamic_cast<Value<Float>*>(data)->valuePtr, sizeof(node.value));
+			break;
+		case DataType::String:
+			node.value = Intern(strings, stringIds, *dynamic_cast<Value<String>*>(data)->valuePtr);
+			break;
+		case DataType::List:
+		case DataType::Map:
+		case DataType::Deque:
+		case DataType::Set:
+		case DataType::OrderedMap:
+			// container literals are always empty
+			break;
+		case DataType::Object:
+		case DataType::Slice:
+			// objects and slices only exist at run time, they are never part of the parsed tree
+			return false;
+		case DataType::Function:
+		{
+			// the image holds the whole program, bodies that were never called are parsed now
+			Function* function = dynamic_cast<Value<Function>*>(data)->valuePtr;
+			if (!function->ParseBody())
+				return false;
+
+			auto itr = functionNames.find(function->function);
+			if (itr == functionNames.end())
+				return false;
+
+			node.value = Intern(names, nameIds, itr->second);
+			node.argumentCount = (unsigned int)function->arguments.size();
+			nodes.push_back(node);
+
+			for (Data* arg : function->arguments)
+				if (!WriteNode(arg))
+					return false;
+
+			return true;
+		}
+		}
+
+		nodes.push_back(node);
+		return true;
+	}
+};
+
+static void LogImageError(const std::string& path, const std::string& message)
+{
+	printf("[ERROR][Script] %s '%s'\n", message.c_str(), path.c_str());
+}
+
+bool Script::SaveImage(const std::string& path)
+{
+	if (rootFunction == nullptr)
+		return false;
+
+	ImageWriter writer;
+
+	// aliases share a function, the smallest name is picked so the output does not depend on hash order
+	for (auto& pair : functionLibrary.functions)
+	{
+		auto itr = writer.functionNames.find(pair.second);
+		if (itr == writer.functionNames.end() || pair.first < itr->second)
+			writer.functionNames[pair.second] = pair.first;
+	}
+
+	if (!writer.WriteNode(rootFunction))
+	{
+		LogImageError(path, "unable to serialize the program for");
+		return false;
+	}
+
+	for (const std::string& str : sourceCode.hiddenStrings)
+		writer.hiddenStrings.push_back(writer.AddToBlob(str));
+
+	for (const std::string& originPath : sourceCode.originPaths)
+		writer.originPaths.push_back(writer.AddToBlob(originPath));
+
+	std::vector<ImageOrigin> origins;
+	for (const SourceOrigin& origin : sourceCode.origins)
+		origins.push_back({ (unsigned int)origin.index, origin.pathIndex, (unsigned int)origin.row });
+
+	ImageString pathString = writer.AddToBlob(sourceCode.path);
+	ImageString textString = writer.AddToBlob(sourceCode.text);
+
+	ImageHeader header = {};
+	memcpy(header.magic, imageMagic, sizeof(header.magic));
+	header.version = imageVersion;
+	header.nodeCount = (unsigned int)writer.nodes.size();
+	header.nodesOffset = sizeof(ImageHeader);
+	header.nameCount = (unsigned int)writer.names.size();
+	header.namesOffset = header.nodesOffset + header.nodeCount * sizeof(ImageNode);
+	header.stringCount = (unsigned int)writer.strings.size();
+	header.stringsOffset = header.namesOffset + header.nameCount * sizeof(ImageString);
+	header.hiddenStringCount = (unsigned int)writer.hiddenStrings.size();
+	header.hiddenStringsOffset = header.stringsOffset + header.stringCount * sizeof(ImageString);
+	header.originPathCount = (unsigned int)writer.originPaths.size();
+	header.originPathsOffset = header.hiddenStringsOffset + header.hiddenStringCount * sizeof(ImageString);
+	header.originCount = (unsigned int)origins.size();
+	header.originsOffset = header.originPathsOffset + header.originPathCount * sizeof(ImageString);
+
+	unsigned int blobOffset = header.originsOffset + header.originCount * sizeof(ImageOrigin);
+	header.pathOffset = blobOffset + pathString.offset;
+	header.pathSize = pathString.size;
+	header.textOffset = blobOffset + textString.offset;
+	header.textSize = textString.size;
+
+	for (std::vector<ImageString>* table : { &writer.names, &writer.strings, &writer.hiddenStrings, &writer.originPaths })
+		for (ImageString& imageString : *table)
+			imageString.offset += blobOffset;
+
+	std::ofstream file;
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		LogImageError(path, "failed to write");
+		return false;
+	}
+
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)writer.nodes.data(), writer.nodes.size() * sizeof(ImageNode));
+	file.write((const char*)writer.names.data(), writer.names.size() * sizeof(ImageString));
+	file.write((const char*)writer.strings.data(), writer.strings.size() * sizeof(ImageString));
+	file.write((const char*)writer.hiddenStrings.data(), writer.hiddenStrings.size() * sizeof(ImageString));
+	file.write((const char*)writer.originPaths.data(), writer.originPaths.size() * sizeof(ImageString));
+	file.write((const char*)origins.data(), origins.size() * sizeof(ImageOrigin));
+	file.write(writer.blob.data(), writer.blob.size());
+	file.close();
+
+	if (file.fail())
+	{
+		LogImageError(path, "failed to write");
+		return false;
+	}
+
+	return true;
+}
+
+static bool ReadImageStrings(const MappedFile& file, unsigned int offset, unsigned int count, std::vector<std::string>& outStrings)
+{
+	if (offset > file.size || count > (file.size - offset) / sizeof(ImageString))
+		return false;
+
+	const ImageString* table = (const ImageString*)(file.data + offset);
+	outStrings.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (table[i].offset > file.size || table[i].size > file.size - table[i].offset)
+			return false;
+
+		outStrings[i].assign(file.data + table[i].offset, table[i].size);
+	}
+
+	return true;
+}
+
+static bool ReadImageSymbols(const MappedFile& file, unsigned int offset, unsigned int count, std::vector<Symbol>& outSymbols)
+{
+	std::vector<std::string> strings;
+	if (!ReadImageStrings(file, offset, count, strings))
+		return false;
+
+	outSymbols.clear();
+	outSymbols.reserve(strings.size());
+	for (const std::string& str : strings)
+		outSymbols.push_back(Symbol::Intern(str));
+
+	return true;
+}
+
+bool Script::ReadImageNode(const ImageNode* nodes, unsigned int nodeCount, unsigned int& nextNode, Data*& outData)
+{
+	if (nextNode >= nodeCount)
+		return false;
+
+	const ImageNode& node = nodes[nextNode++];
+	Token token(node.index, sourceCode.id);
+
+	switch ((DataType)node.type)
+	{
+	case DataType::Bool:
+	{
+		Value<Bool>* val = Memory<Value<Bool>>().New(DataType::Bool, true, token);
+		val->SetValue(node.value != 0);
+		outData = val;
+		return true;
+	}
+	case DataType::Int:
+	{
+		Value<Int>* val = Memory<Value<Int>>().New(DataType::Int, true, token);
+		val->SetValue((int)node.value);
+		outData = val;
+		return true;
+	}
+	case DataType::Float:
+	{
+		float floatValue;
+		memcpy(&floatValue, &node.value, sizeof(floatValue));
+		Value<Float>* val = Memory<Value<Float>>().New(DataType::Float, true, token);
+		val->SetValue(floatValue);
+		outData = val;
+		return true;
+	}
+	case DataType::String:
+	{
+		if (node.value >= lexer.strings.size())
+			return false;
+
+		Value<String>* val = Memory<Value<String>>().New(DataType::String, true, token);
+		val->SetValue(lexer.strings[node.value].Text());
+		outData = val;
+		return true;
+	}
+	case DataType::List:
+	{
+		Value<List>* val = Memory<Value<List>>().New(DataType::List, true, token);
+		val->SetValue({});
+		outData = val;
+		return true;
+	}
+	case DataType::Map:
+	{
+		Value<Map>* val = Memory<Value<Map>>().New(DataType::Map, true, token);
+		val->SetValue({});
+		outData = val;
+		return true;
+	}
+	case DataType::Deque:
+	{
+		Value<Deque>* val = Memory<Value<Deque>>().New(DataType::Deque, true, token);
+		val->SetValue({});
+		outData = val;
+		return true;
+	}
+	case DataType::Set:
+	{
+		Value<Set>* val = Memory<Value<Set>>().New(DataType::Set, true, token);
+		val->SetValue({});
+		outData = val;
+		return true;
+	}
+	case DataType::OrderedMap:
+	{
+		Value<OrderedMap>* val = Memory<Value<OrderedMap>>().New(DataType::OrderedMap, true, token);
+		val->Init();
+		outData = val;
+		return true;
+	}
+	case DataType::Function:
+	{
+		if (node.value >= nameFunctions.size() || nameFunctions[node.value] == nullptr)
+			return false;
+
+		Value<Function>* val = Memory<Value<Function>>().New(DataType::Function, true, token);
+		val->SetValue(nameFunctions[node.value]);
+		outData = val;
+
+		for (unsigned int i = 0; i < node.argumentCount; i++)
+		{
+			Data* arg = nullptr;
+			if (!ReadImageNode(nodes, nodeCount, nextNode, arg))
+				return false;
+
+			val->valuePtr->AddArgument(arg);
+		}
+
+		return true;
+	}
+	case DataType::Object:
+	case DataType::Slice:
+		break;
+	}
+
+	return false;
+}
+
+bool Script::LoadImage(const std::string& path)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		LogImageError(path, "failed to read precompiled script");
+		return false;
+	}
+
+	if (file.size < sizeof(ImageHeader))
+	{
+		LogImageError(path, "truncated precompiled script");
+		return false;
+	}
+
+	const ImageHeader& header = *(const ImageHeader*)file.data;
+	if (memcmp(header.magic, imageMagic, sizeof(header.magic)) != 0 || header.version != imageVersion)
+	{
+		LogImageError(path, "unsupported precompiled script");
+		return false;
+	}
+
+	if (header.nodesOffset > file.size || header.nodeCount > (file.size - header.nodesOffset) / sizeof(ImageNode)
+		|| header.pathOffset > file.size || header.pathSize > file.size - header.pathOffset
+		|| header.textOffset > file.size || header.textSize > file.size - header.textOffset
+		|| !ReadImageSymbols(file, header.namesOffset, header.nameCount, lexer.names)
+		|| !ReadImageSymbols(file, header.stringsOffset, header.stringCount, lexer.strings)
+		|| header.originsOffset > file.size || header.originCount > (file.size - header.originsOffset) / sizeof(ImageOrigin)
+		|| !ReadImageStrings(file, header.hiddenStringsOffset, header.hiddenStringCount, sourceCode.hiddenStrings)
+		|| !ReadImageStrings(file, header.originPathsOffset, header.originPathCount, sourceCode.originPaths))
+	{
+		LogImageError(path, "corrupt precompiled script");
+		return false;
+	}
+
+	// the expanded text is only kept for error messages
+	sourceCode.path.assign(file.data + header.pathOffset, header.pathSize);
+	sourceCode.text.assign(file.data + header.textOffset, header.textSize);
+	sourceCode.Reset();
+
+	const ImageOrigin* origins = (const ImageOrigin*)(file.data + header.originsOffset);
+	sourceCode.origins.clear();
+	for (unsigned int i = 0; i < header.originCount; i++)
+	{
+		if (origins[i].pathIndex < -1 || origins[i].pathIndex >= (int)sourceCode.originPaths.size())
+		{
+			LogImageError(path, "corrupt precompiled script");
+			return false;
+		}
+
+		sourceCode.origins.push_back({ (int)origins[i].index, origins[i].pathIndex, (int)origins[i].row });
+	}
+
+	nameFunctions.resize(lexer.names.size());
+	for (int i = 0; i < lexer.names.size(); i++)
+	{
+		auto itr = functionLibrary.functions.find(lexer.names[i].Text());
+		if (itr == functionLibrary.functions.end())
+		{
+			LogImageError(path, "unknown function '" + lexer.names[i].Text() + "' in");
+			return false;
+		}
+
+		nameFunctions[i] = itr->second;
+	}
+
+	const ImageNode* nodes = (const ImageNode*)(file.data + header.nodesOffset);
+	unsigned int nextNode = 0;
+	Data* res = nullptr;
+	if (!ReadImageNode(nodes, header.nodeCount, nextNode, res) || res->type != DataType::Function)
+	{
+		LogImageError(path, "corrupt precompiled script");
+		return false;
+	}
+
+	rootFunction = dynamic_cast<Value<Function>*>(res);
+	return true;
+}
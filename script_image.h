@@ -0,0 +1,57 @@
+#pragma once
+
+// layout of a precompiled '.funkyc' script, written by Script::SaveImage and read by Script::LoadImage.
+// it is a serialized syntax tree, not an executable image: LoadImage decodes every node into a new pool allocation
+// and copies the strings and the expanded text out of the file, then the file is closed. what it saves is reading
+// the source, preprocessing and lexing. every offset is relative to the start of the file.
+// nodes are stored in preorder, a function node is followed by its arguments.
+
+struct ImageHeader
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int nodeCount;
+	unsigned int nodesOffset;
+	unsigned int nameCount;
+	unsigned int namesOffset;
+	unsigned int stringCount;
+	unsigned int stringsOffset;
+	unsigned int hiddenStringCount;
+	unsigned int hiddenStringsOffset;
+	unsigned int pathOffset;
+	unsigned int pathSize;
+	unsigned int textOffset;
+	unsigned int textSize;
+	unsigned int originPathCount;
+	unsigned int originPathsOffset;
+	unsigned int originCount;
+	unsigned int originsOffset;
+};
+
+struct ImageString
+{
+	unsigned int offset;
+	unsigned int size;
+};
+
+// a SourceOrigin of the expanded text, so errors name the file and line the code came from
+struct ImageOrigin
+{
+	unsigned int index;
+	int pathIndex;
+	unsigned int row;
+};
+
+struct ImageNode
+{
+	unsigned char type;
+	unsigned char padding[3];
+	// offset into the expanded text, used for error messages
+	unsigned int index;
+	// bool, int and float bits, string index or function name index
+	unsigned int value;
+	unsigned int argumentCount;
+};
+
+static const char imageMagic[8] = { 'F', 'U', 'N', 'K', 'Y', 'C', 0, 0 };
+static const unsigned int imageVersion = 2;
@@ -0,0 +1,545 @@
+#include "simd.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// scalar fallbacks, ints go through unsigned so overflow wraps instead of being undefined
+
+static int SumIntScalar(const int* a, int n)
+{
+	unsigned int sum = 0;
+	for (int i = 0; i < n; i++)
+		sum += (unsigned int)a[i];
+
+	return (int)sum;
+}
+
+static float SumFloatScalar(const float* a, int n)
+{
+	float sum = 0.0f;
+	for (int i = 0; i < n; i++)
+		sum += a[i];
+
+	return sum;
+}
+
+template<typename T>
+static T MinScalar(const T* a, int n)
+{
+	T result = a[0];
+	for (int i = 1; i < n; i++)
+		result = std::min(result, a[i]);
+
+	return result;
+}
+
+template<typename T>
+static T MaxScalar(const T* a, int n)
+{
+	T result = a[0];
+	for (int i = 1; i < n; i++)
+		result = std::max(result, a[i]);
+
+	return result;
+}
+
+static int DotIntScalar(const int* a, const int* b, int n)
+{
+	unsigned int sum = 0;
+	for (int i = 0; i < n; i++)
+		sum += (unsigned int)a[i] * (unsigned int)b[i];
+
+	return (int)sum;
+}
+
+static float DotFloatScalar(const float* a, const float* b, int n)
+{
+	float sum = 0.0f;
+	for (int i = 0; i < n; i++)
+		sum += a[i] * b[i];
+
+	return sum;
+}
+
+static void AddIntScalar(const int* a, const int* b, int* out, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = (int)((unsigned int)a[i] + (unsigned int)b[i]);
+}
+
+static void AddFloatScalar(const float* a, const float* b, float* out, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = a[i] + b[i];
+}
+
+static void SubIntScalar(const int* a, const int* b, int* out, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = (int)((unsigned int)a[i] - (unsigned int)b[i]);
+}
+
+static void SubFloatScalar(const float* a, const float* b, float* out, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = a[i] - b[i];
+}
+
+static void MulIntScalar(const int* a, const int* b, int* out, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = (int)((unsigned int)a[i] * (unsigned int)b[i]);
+}
+
+static void MulFloatScalar(const float* a, const float* b, float* out, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = a[i] * b[i];
+}
+
+static void ScaleIntScalar(const int* a, int s, int* out, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = (int)((unsigned int)a[i] * (unsigned int)s);
+}
+
+static void ScaleFloatScalar(const float* a, float s, float* out, int n)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = a[i] * s;
+}
+
+#ifdef SIMD_X86
+
+// sse2 is part of every x86-64 cpu, it has no 32 bit int min, max or multiply so those stay scalar
+
+static float SumFloatSse2(const float* a, int n)
+{
+	__m128 acc = _mm_setzero_ps();
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		acc = _mm_add_ps(acc, _mm_loadu_ps(a + i));
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; i < n; i++)
+		sum += a[i];
+
+	return sum;
+}
+
+static int SumIntSse2(const int* a, int n)
+{
+	__m128i acc = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i*)(a + i)));
+
+	int lanes[4];
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	return (int)((unsigned int)SumIntScalar(lanes, 4) + (unsigned int)SumIntScalar(a + i, n - i));
+}
+
+static float MinFloatSse2(const float* a, int n)
+{
+	if (n < 4)
+		return MinScalar(a, n);
+
+	__m128 acc = _mm_loadu_ps(a);
+	int i = 4;
+	for (; i + 4 <= n; i += 4)
+		acc = _mm_min_ps(acc, _mm_loadu_ps(a + i));
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	float result = MinScalar(lanes, 4);
+	for (; i < n; i++)
+		result = std::min(result, a[i]);
+
+	return result;
+}
+
+static float MaxFloatSse2(const float* a, int n)
+{
+	if (n < 4)
+		return MaxScalar(a, n);
+
+	__m128 acc = _mm_loadu_ps(a);
+	int i = 4;
+	for (; i + 4 <= n; i += 4)
+		acc = _mm_max_ps(acc, _mm_loadu_ps(a + i));
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	float result = MaxScalar(lanes, 4);
+	for (; i < n; i++)
+		result = std::max(result, a[i]);
+
+	return result;
+}
+
+static float DotFloatSse2(const float* a, const float* b, int n)
+{
+	__m128 acc = _mm_setzero_ps();
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; i < n; i++)
+		sum += a[i] * b[i];
+
+	return sum;
+}
+
+static void AddIntSse2(const int* a, const int* b, int* out, int n)
+{
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+
+	AddIntScalar(a + i, b + i, out + i, n - i);
+}
+
+static void AddFloatSse2(const float* a, const float* b, float* out, int n)
+{
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+	AddFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+static void SubIntSse2(const int* a, const int* b, int* out, int n)
+{
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i))));
+
+	SubIntScalar(a + i, b + i, out + i, n - i);
+}
+
+static void SubFloatSse2(const float* a, const float* b, float* out, int n)
+{
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(out + i, _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+	SubFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+static void MulFloatSse2(const float* a, const float* b, float* out, int n)
+{
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+	MulFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+static void ScaleFloatSse2(const float* a, float s, float* out, int n)
+{
+	__m128 scale = _mm_set1_ps(s);
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), scale));
+
+	ScaleFloatScalar(a + i, s, out + i, n - i);
+}
+
+TARGET_AVX2 static float SumFloatAvx2(const float* a, int n)
+{
+	__m256 acc = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm256_add_ps(acc, _mm256_loadu_ps(a + i));
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, acc);
+	float sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+	for (; i < n; i++)
+		sum += a[i];
+
+	return sum;
+}
+
+TARGET_AVX2 static int SumIntAvx2(const int* a, int n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm256_add_epi32(acc, _mm256_loadu_si256((const __m256i*)(a + i)));
+
+	int lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	return (int)((unsigned int)SumIntScalar(lanes, 8) + (unsigned int)SumIntScalar(a + i, n - i));
+}
+
+TARGET_AVX2 static float MinFloatAvx2(const float* a, int n)
+{
+	if (n < 8)
+		return MinScalar(a, n);
+
+	__m256 acc = _mm256_loadu_ps(a);
+	int i = 8;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm256_min_ps(acc, _mm256_loadu_ps(a + i));
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, acc);
+	float result = MinScalar(lanes, 8);
+	for (; i < n; i++)
+		result = std::min(result, a[i]);
+
+	return result;
+}
+
+TARGET_AVX2 static float MaxFloatAvx2(const float* a, int n)
+{
+	if (n < 8)
+		return MaxScalar(a, n);
+
+	__m256 acc = _mm256_loadu_ps(a);
+	int i = 8;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm256_max_ps(acc, _mm256_loadu_ps(a + i));
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, acc);
+	float result = MaxScalar(lanes, 8);
+	for (; i < n; i++)
+		result = std::max(result, a[i]);
+
+	return result;
+}
+
+TARGET_AVX2 static int MinIntAvx2(const int* a, int n)
+{
+	if (n < 8)
+		return MinScalar(a, n);
+
+	__m256i acc = _mm256_loadu_si256((const __m256i*)a);
+	int i = 8;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm256_min_epi32(acc, _mm256_loadu_si256((const __m256i*)(a + i)));
+
+	int lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	int result = MinScalar(lanes, 8);
+	for (; i < n; i++)
+		result = std::min(result, a[i]);
+
+	return result;
+}
+
+TARGET_AVX2 static int MaxIntAvx2(const int* a, int n)
+{
+	if (n < 8)
+		return MaxScalar(a, n);
+
+	__m256i acc = _mm256_loadu_si256((const __m256i*)a);
+	int i = 8;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm256_max_epi32(acc, _mm256_loadu_si256((const __m256i*)(a + i)));
+
+	int lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	int result = MaxScalar(lanes, 8);
+	for (; i < n; i++)
+		result = std::max(result, a[i]);
+
+	return result;
+}
+
+TARGET_AVX2 static int DotIntAvx2(const int* a, const int* b, int n)
+{
+	__m256i acc = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+
+	int lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	return (int)((unsigned int)SumIntScalar(lanes, 8) + (unsigned int)DotIntScalar(a + i, b + i, n - i));
+}
+
+TARGET_AVX2 static float DotFloatAvx2(const float* a, const float* b, int n)
+{
+	__m256 acc = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, acc);
+	float sum = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+	for (; i < n; i++)
+		sum += a[i] * b[i];
+
+	return sum;
+}
+
+TARGET_AVX2 static void AddIntAvx2(const int* a, const int* b, int* out, int n)
+{
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+
+	AddIntScalar(a + i, b + i, out + i, n - i);
+}
+
+TARGET_AVX2 static void AddFloatAvx2(const float* a, const float* b, float* out, int n)
+{
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+
+	AddFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+TARGET_AVX2 static void SubIntAvx2(const int* a, const int* b, int* out, int n)
+{
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+
+	SubIntScalar(a + i, b + i, out + i, n - i);
+}
+
+TARGET_AVX2 static void SubFloatAvx2(const float* a, const float* b, float* out, int n)
+{
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+
+	SubFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+TARGET_AVX2 static void MulIntAvx2(const int* a, const int* b, int* out, int n)
+{
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i))));
+
+	MulIntScalar(a + i, b + i, out + i, n - i);
+}
+
+TARGET_AVX2 static void MulFloatAvx2(const float* a, const float* b, float* out, int n)
+{
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+
+	MulFloatScalar(a + i, b + i, out + i, n - i);
+}
+
+TARGET_AVX2 static void ScaleIntAvx2(const int* a, int s, int* out, int n)
+{
+	__m256i scale = _mm256_set1_epi32(s);
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(a + i)), scale));
+
+	ScaleIntScalar(a + i, s, out + i, n - i);
+}
+
+TARGET_AVX2 static void ScaleFloatAvx2(const float* a, float s, float* out, int n)
+{
+	__m256 scale = _mm256_set1_ps(s);
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), scale));
+
+	ScaleFloatScalar(a + i, s, out + i, n - i);
+}
+
+static bool CpuHasAvx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	// the os has to save the ymm registers too (osxsave + xgetbv)
+	if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static SimdKernels PickKernels()
+{
+	SimdKernels kernels =
+	{
+		"scalar",
+		SumIntScalar, SumFloatScalar,
+		MinScalar<int>, MinScalar<float>,
+		MaxScalar<int>, MaxScalar<float>,
+		DotIntScalar, DotFloatScalar,
+		AddIntScalar, AddFloatScalar,
+		SubIntScalar, SubFloatScalar,
+		MulIntScalar, MulFloatScalar,
+		ScaleIntScalar, ScaleFloatScalar
+	};
+
+#ifdef SIMD_X86
+	if (CpuHasAvx2())
+	{
+		kernels =
+		{
+			"avx2",
+			SumIntAvx2, SumFloatAvx2,
+			MinIntAvx2, MinFloatAvx2,
+			MaxIntAvx2, MaxFloatAvx2,
+			DotIntAvx2, DotFloatAvx2,
+			AddIntAvx2, AddFloatAvx2,
+			SubIntAvx2, SubFloatAvx2,
+			MulIntAvx2, MulFloatAvx2,
+			ScaleIntAvx2, ScaleFloatAvx2
+		};
+	}
+	else
+	{
+		kernels =
+		{
+			"sse2",
+			SumIntSse2, SumFloatSse2,
+			MinScalar<int>, MinFloatSse2,
+			MaxScalar<int>, MaxFloatSse2,
+			DotIntScalar, DotFloatSse2,
+			AddIntSse2, AddFloatSse2,
+			SubIntSse2, SubFloatSse2,
+			MulIntScalar, MulFloatSse2,
+			ScaleIntScalar, ScaleFloatSse2
+		};
+	}
+#endif
+
+	return kernels;
+}
+
+const SimdKernels& Simd()
+{
+	static const SimdKernels kernels = PickKernels();
+	return kernels;
+}
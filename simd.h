@@ -0,0 +1,29 @@
+#pragma once
+
+// bulk kernels over plain int and float arrays, used by the list builtins (sum, dot, vadd, ...).
+// the set is picked once from what the cpu supports: avx2, sse2 or plain scalar loops.
+// int arithmetic wraps around, float sums are added lane by lane so their rounding may differ from a plain loop.
+struct SimdKernels
+{
+	const char* name;
+
+	int (*sumInt)(const int* a, int n);
+	float (*sumFloat)(const float* a, int n);
+	int (*minInt)(const int* a, int n);
+	float (*minFloat)(const float* a, int n);
+	int (*maxInt)(const int* a, int n);
+	float (*maxFloat)(const float* a, int n);
+	int (*dotInt)(const int* a, const int* b, int n);
+	float (*dotFloat)(const float* a, const float* b, int n);
+
+	void (*addInt)(const int* a, const int* b, int* out, int n);
+	void (*addFloat)(const float* a, const float* b, float* out, int n);
+	void (*subInt)(const int* a, const int* b, int* out, int n);
+	void (*subFloat)(const float* a, const float* b, float* out, int n);
+	void (*mulInt)(const int* a, const int* b, int* out, int n);
+	void (*mulFloat)(const float* a, const float* b, float* out, int n);
+	void (*scaleInt)(const int* a, int s, int* out, int n);
+	void (*scaleFloat)(const float* a, float s, float* out, int n);
+};
+
+const SimdKernels& Simd();
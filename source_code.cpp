@@ -1,7 +1,8 @@
 #include "source_code.h"
 #include "data.h"
-#include <fstream>
-#include <sstream>
+#include "mapped_file.h"
+#include <algorithm>
+#include <mutex>
 #include <stdio.h>
 
 void LogError(const std::string& message)
@@ -9,29 +10,87 @@ void LogError(const std::string& message)
 	printf("[ERROR][SourceCode] %s\n", message.c_str());
 }
 
+// never freed, sources held by other statics unregister during exit
+static std::vector<SourceCode*>& Registry()
+{
+	static std::vector<SourceCode*>* registry = new std::vector<SourceCode*>();
+	return *registry;
+}
+
+// sources may be created and destroyed from preprocessing threads
+static std::mutex& RegistryMutex()
+{
+	static std::mutex* registryMutex = new std::mutex();
+	return *registryMutex;
+}
+
+// the slot after the one handed out last, freed ids are only reused once every id has been handed out so a token
+// that outlived its source does not point at the next one right away
+static size_t nextSlot = 0;
+
 SourceCode::SourceCode()
 {
-	row = -1;
-	col = -1;
 	index = -1;
+	id = noSourceId;
+
+	std::lock_guard<std::mutex> lock(RegistryMutex());
+	std::vector<SourceCode*>& registry = Registry();
+	if (registry.size() < noSourceId)
+	{
+		id = (unsigned short)registry.size();
+		registry.push_back(this);
+		return;
+	}
+
+	for (size_t i = 0; i < registry.size(); i++)
+	{
+		size_t slot = (nextSlot + i) % registry.size();
+		if (registry[slot] == nullptr)
+		{
+			registry[slot] = this;
+			id = (unsigned short)slot;
+			nextSlot = slot + 1;
+			return;
+		}
+	}
+
+	// errors in this source print without a position
+	LogError("too many sources loaded at once, " + std::to_string((int)noSourceId) + " is the limit");
+}
+
+SourceCode::~SourceCode()
+{
+	if (id == noSourceId)
+		return;
+
+	std::lock_guard<std::mutex> lock(RegistryMutex());
+	Registry()[id] = nullptr;
+}
+
+SourceCode* SourceCode::Get(unsigned short sourceId)
+{
+	std::lock_guard<std::mutex> lock(RegistryMutex());
+	std::vector<SourceCode*>& registry = Registry();
+	if (sourceId >= registry.size())
+		return nullptr;
+
+	return registry[sourceId];
 }
 
 bool SourceCode::ReadFile(const std::string& _path)
 {
 	path = _path;
-	row = 1;
-	col = 1;
 	index = 0;
+	lineStarts.clear();
+	hiddenStrings.clear();
+	origins.clear();
+	originPaths.clear();
 
-	std::ifstream file;
-	file.open(path);
-
-	if (file.is_open())
+	// the file is copied straight from its mapping, not through a stream buffer
+	MappedFile file;
+	if (file.Open(path))
 	{
-		std::stringstream stringStream;
-		stringStream << file.rdbuf();
-		text = stringStream.str();
-		file.close();
+		file.CopyText(text);
 		return true;
 	}
 
@@ -41,9 +100,8 @@ bool SourceCode::ReadFile(const std::string& _path)
 
 void SourceCode::Reset()
 {
-	row = 1;
-	col = 1;
 	index = 0;
+	lineStarts.clear();
 }
 
 char SourceCode::CurrentChar()
@@ -53,18 +111,17 @@ char SourceCode::CurrentChar()
 
 bool SourceCode::NextChar()
 {
-	if (index + 1 >= text.size())
+	if (index >= text.size())
 		return false;
 
-	col++;
-	if (CurrentChar() == '\n')
-	{
-		col = 1;
-		row++;
-	}
 	index++;
 
-	return true;
+	return index < text.size();
+}
+
+bool SourceCode::AtEnd()
+{
+	return index >= text.size();
 }
 
 void SourceCode::MoveAlong(int steps)
@@ -72,21 +129,133 @@ void SourceCode::MoveAlong(int steps)
 	for (int i = 0; i < steps && NextChar(); i++);
 }
 
+void SourceCode::FindRowCol(int i, int& outRow, int& outCol)
+{
+	outRow = RowAt(i);
+	outCol = (int)ShowStrings(lineStarts[outRow - 1], i - 1).size() + 1;
+}
+
+int SourceCode::RowAt(int i)
+{
+	if (lineStarts.empty())
+	{
+		lineStarts.push_back(0);
+		for (int j = 0; j < text.size(); j++)
+			if (text[j] == '\n')
+				lineStarts.push_back(j + 1);
+	}
+
+	return (int)(std::upper_bound(lineStarts.begin(), lineStarts.end(), i) - lineStarts.begin());
+}
+
+void SourceCode::FindOrigin(int i, int& outPathIndex, int& outRow)
+{
+	// the row counts on from the last origin at or before i
+	auto itr = std::upper_bound(origins.begin(), origins.end(), i, [](int j, const SourceOrigin& origin) { return j < origin.index; });
+	if (itr == origins.begin())
+	{
+		outPathIndex = -1;
+		outRow = RowAt(i);
+		return;
+	}
+
+	--itr;
+	outPathIndex = itr->pathIndex;
+	outRow = itr->row + RowAt(i) - RowAt(itr->index);
+}
+
+const std::string& SourceCode::OriginPath(int pathIndex) const
+{
+	return pathIndex < 0 ? path : originPaths[pathIndex];
+}
+
+int SourceCode::AddOriginPath(const std::string& originPath)
+{
+	if (originPath == path)
+		return -1;
+
+	auto itr = std::find(originPaths.begin(), originPaths.end(), originPath);
+	if (itr != originPaths.end())
+		return (int)(itr - originPaths.begin());
+
+	originPaths.push_back(originPath);
+	return (int)originPaths.size() - 1;
+}
+
+void SourceCode::SetText(std::string& newText, const std::vector<SourceOrigin>& newOrigins)
+{
+	// newText is taken over. newOrigins are sorted by index, the ones that counting lines already gives are dropped
+	text = std::move(newText);
+	lineStarts.clear();
+	origins.clear();
+
+	for (const SourceOrigin& origin : newOrigins)
+	{
+		int pathIndex, row;
+		FindOrigin(origin.index, pathIndex, row);
+		if (pathIndex == origin.pathIndex && row == origin.row)
+			continue;
+
+		if (!origins.empty() && origins.back().index == origin.index)
+			origins.back() = origin;
+		else
+			origins.push_back(origin);
+	}
+}
+
+void SourceCode::MoveText(std::string& newText, const std::vector<std::pair<int, int>>& anchors)
+{
+	// anchors pair an index of the old text with where it is in newText, sorted by both. text between two anchors
+	// was copied or replaced as a whole, origins inside it move along with the anchor before it
+	std::vector<SourceOrigin> newOrigins;
+	newOrigins.reserve(origins.size() + anchors.size());
+
+	size_t nextOrigin = 0;
+	std::pair<int, int> previous(0, 0);
+	for (size_t i = 0; i <= anchors.size(); i++)
+	{
+		int oldEnd = (i < anchors.size() ? anchors[i].first : (int)text.size() + 1);
+		int newEnd = (i < anchors.size() ? anchors[i].second : (int)newText.size());
+		for (; nextOrigin < origins.size() && origins[nextOrigin].index < oldEnd; nextOrigin++)
+		{
+			SourceOrigin origin = origins[nextOrigin];
+			origin.index = previous.second + std::min(origin.index - previous.first, newEnd - previous.second);
+			newOrigins.push_back(origin);
+		}
+
+		if (i == anchors.size())
+			break;
+
+		SourceOrigin origin;
+		origin.index = anchors[i].second;
+		FindOrigin(anchors[i].first, origin.pathIndex, origin.row);
+		newOrigins.push_back(origin);
+		previous = anchors[i];
+	}
+
+	SetText(newText, newOrigins);
+}
+
 void SourceCode::PrintError(const Token& token, const std::string& message)
 {
-	int rowStart = 0;
-	for (int i = token.index; i >= 0 && text[i] != '\n'; rowStart = i--);
+	int row, col;
+	FindRowCol(token.index, row, col);
 
-	int rowEnd = 0;
-	for (int i = token.index; i < text.size() && text[i] != '\n'; rowEnd = i++);
+	int rowStart = lineStarts[row - 1];
+	int rowEnd = (row < lineStarts.size() ? lineStarts[row] - 2 : (int)text.size() - 1);
 
-	std::string rowSample = text.substr(rowStart, rowEnd - rowStart + 1);
-	std::string str = "in '" + path + "' on line " + std::to_string(token.row) + " col " + std::to_string(token.col)
+	// the row shown is the one that ran, the line number is the one in the file it came from
+	int originPathIndex, originRow;
+	FindOrigin(token.index, originPathIndex, originRow);
+
+	std::string rowSample = ShowStrings(rowStart, rowEnd);
+	int markerIndex = col - 1;
+	std::string str = "in '" + OriginPath(originPathIndex) + "' on line " + std::to_string(originRow) + " col " + std::to_string(col)
 		+ "\n" + message + ":\n" + rowSample + "\n";
 
-	for (int i = rowStart; i < token.index; i++)
+	for (int i = 0; i < markerIndex; i++)
 	{
-		if (text[i] == '\t')
+		if (rowSample[i] == '\t')
 			str += "--------";
 		else
 			str += "-";
@@ -94,9 +263,9 @@ void SourceCode::PrintError(const Token& token, const std::string& message)
 
 	str += "^";
 
-	for (int i = token.index + 1; i <= rowEnd; i++)
+	for (int i = markerIndex + 1; i < rowSample.size(); i++)
 	{
-		if (text[i] == '\t')
+		if (rowSample[i] == '\t')
 			str += "---";
 		else
 			str += "-";
@@ -107,7 +276,7 @@ void SourceCode::PrintError(const Token& token, const std::string& message)
 
 void SourceCode::PrintErrorAtCurrentIndex(const std::string& message)
 {
-	PrintError(Token(row, col, index, nullptr), message);
+	PrintError(Token(index, id), message);
 }
 
 std::string SourceCode::Substring(int first, int last)
@@ -125,4 +294,48 @@ bool SourceCode::BeginsWith(const std::string& str)
 			return false;
 
 	return true;
+}
+
+bool SourceCode::IsHiddenString(int i, int& outStringIndex)
+{
+	if (i < 0 || i + hiddenStringKeySize > text.size() || text[i] != '@' || text[i + hiddenStringKeySize - 1] != '@')
+		return false;
+
+	int stringIndex = 0;
+	for (int j = i + 1; j < i + hiddenStringKeySize - 1; j++)
+	{
+		char c = text[j];
+		if (c < '0' || c > '9')
+			return false;
+
+		stringIndex = stringIndex * 10 + (c - '0');
+	}
+
+	if (stringIndex >= hiddenStrings.size())
+		return false;
+
+	outStringIndex = stringIndex;
+	return true;
+}
+
+std::string SourceCode::ShowStrings(int first, int last)
+{
+	std::string shown;
+	shown.reserve(last - first + 1);
+
+	for (int i = first; i <= last && i < text.size(); i++)
+	{
+		int stringIndex;
+		if (i + hiddenStringKeySize - 1 <= last && IsHiddenString(i, stringIndex))
+		{
+			shown += '"';
+			shown += hiddenStrings[stringIndex];
+			shown += '"';
+			i += hiddenStringKeySize - 1;
+		}
+		else
+			shown += text[i];
+	}
+
+	return shown;
 }
\ No newline at end of file
@@ -1,15 +1,48 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <utility>
+
+void LogError(const std::string& message);
+
+// from index on, the text continues at line row of the file it came from
+struct SourceOrigin
+{
+	int index;
+	// into originPaths, -1 for the path of the text itself
+	int pathIndex;
+	int row;
+};
 
 struct SourceCode
 {
 	std::string path;
-	int row;
-	int col;
+	unsigned short id;
 	int index;
 	std::string text;
+	std::vector<std::string> hiddenStrings;
+
+	// offsets of the first char of every line, built on the first error and dropped by Reset
+	std::vector<int> lineStarts;
+
+	// where parts of the text came from once includes, comments and macros moved lines around,
+	// empty while the text still lines up with the file at path
+	std::vector<SourceOrigin> origins;
+	std::vector<std::string> originPaths;
+
+	// string literals are swapped for fixed width keys "@00000000@" while preprocessing
+	static const int hiddenStringKeySize = 10;
+
+	// tokens refer to their source by id, live sources are kept in a registry. ids are not reused until every id
+	// has been handed out, a source made while all of them are live gets noSourceId
+	static const unsigned short noSourceId = 0xFFFF;
 
 	SourceCode();
+	SourceCode(const SourceCode&) = delete;
+	SourceCode& operator=(const SourceCode&) = delete;
+	~SourceCode();
+
+	static SourceCode* Get(unsigned short sourceId);
 
 	bool ReadFile(const std::string& _path);
 
@@ -19,8 +52,24 @@ struct SourceCode
 
 	bool NextChar();
 
+	bool AtEnd();
+
 	void MoveAlong(int steps);
 
+	void FindRowCol(int i, int& outRow, int& outCol);
+
+	int RowAt(int i);
+
+	void FindOrigin(int i, int& outPathIndex, int& outRow);
+
+	const std::string& OriginPath(int pathIndex) const;
+
+	int AddOriginPath(const std::string& originPath);
+
+	void SetText(std::string& newText, const std::vector<SourceOrigin>& newOrigins);
+
+	void MoveText(std::string& newText, const std::vector<std::pair<int, int>>& anchors);
+
 	void PrintError(const struct Token& token, const std::string& message);
 
 	void PrintErrorAtCurrentIndex(const std::string& message);
@@ -28,4 +77,8 @@ struct SourceCode
 	std::string Substring(int first, int last);
 
 	bool BeginsWith(const std::string& str);
+
+	bool IsHiddenString(int i, int& outStringIndex);
+
+	std::string ShowStrings(int first, int last);
 };
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "symbol.h"
+#include <unordered_set>
+#include <mutex>
+
+// scripts may be parsed on several threads, the table is shared by all of them.
+// unordered_set never moves its elements, so the texts handed out stay valid as it grows
+static std::mutex& SymbolMutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
+static std::unordered_set<std::string>& SymbolTable()
+{
+	// never destroyed, symbols may still be compared while other statics are torn down
+	static auto* table = new std::unordered_set<std::string>();
+	return *table;
+}
+
+Symbol::Symbol()
+{
+	text = nullptr;
+}
+
+Symbol Symbol::Intern(const std::string& str)
+{
+	std::lock_guard<std::mutex> lock(SymbolMutex());
+	Symbol symbol;
+	symbol.text = &*SymbolTable().insert(str).first;
+	return symbol;
+}
+
+Symbol Symbol::Find(const std::string& str)
+{
+	// a null symbol when the text was never interned
+	std::lock_guard<std::mutex> lock(SymbolMutex());
+	Symbol symbol;
+	auto itr = SymbolTable().find(str);
+	if (itr != SymbolTable().end())
+		symbol.text = &*itr;
+
+	return symbol;
+}
+
+const std::string& Symbol::Text() const
+{
+	return *text;
+}
+
+bool Symbol::IsNull() const
+{
+	return text == nullptr;
+}
+
+bool Symbol::operator==(const Symbol& other) const
+{
+	return text == other.text;
+}
+
+bool Symbol::operator!=(const Symbol& other) const
+{
+	return text != other.text;
+}
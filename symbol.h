@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <functional>
+
+// an interned string. each distinct text is stored once for the whole process, so two symbols are equal exactly
+// when they point at the same text, and hashing a symbol hashes a pointer. interned texts are never freed, so only
+// names and string literals are interned. strings made at run time are only looked up with Find.
+struct Symbol
+{
+	const std::string* text;
+
+	Symbol();
+
+	static Symbol Intern(const std::string& str);
+
+	static Symbol Find(const std::string& str);
+
+	const std::string& Text() const;
+
+	bool IsNull() const;
+
+	bool operator==(const Symbol& other) const;
+
+	bool operator!=(const Symbol& other) const;
+};
+
+namespace std
+{
+	template<>
+	struct hash<Symbol>
+	{
+		size_t operator()(const Symbol& symbol) const
+		{
+			return std::hash<const std::string*>()(symbol.text);
+		}
+	};
+}
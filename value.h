@@ -9,6 +9,11 @@ typedef float Float;
 typedef std::string String;
 struct List;
 struct Map;
+struct Deque;
+struct Object;
+struct Slice;
+struct Set;
+struct OrderedMap;
 struct Function;
 
 template<typename T>
@@ -85,7 +90,7 @@ struct Value : public Data
 	{
 		if (isConst)
 		{
-			token.sourceCodePtr->PrintError(token, "trying to change a constant variable");
+			token.PrintError("trying to change a constant variable");
 			return;
 		}
 
@@ -105,7 +110,7 @@ struct Value : public Data
 	{
 		if (isConst)
 		{
-			token.sourceCodePtr->PrintError(token, "trying to change a constant variable");
+			token.PrintError("trying to change a constant variable");
 			return;
 		}
 
@@ -119,4 +124,8 @@ struct Value : public Data
 
 		*valuePtr = *value->valuePtr;
 	}
-};
\ No newline at end of file
+};
+
+// copying a list shares its elements, see value_types.cpp
+template<>
+void Value<List>::CopyOther(Data* data);
\ No newline at end of file
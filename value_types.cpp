@@ -1,6 +1,9 @@
 #include "value_types.h"
 #include "value.h"
 #include "memory_pool.h"
+#include "script.h"
+#include <algorithm>
+#include <stdexcept>
 
 void FreeData(Data* data)
 {
@@ -30,13 +33,37 @@ void FreeData(Data* data)
 	case DataType::Function:
 		Memory<Value<Function>>().Delete(dynamic_cast<Value<Function>*>(data));
 		break;
+	case DataType::Deque:
+		Memory<Value<Deque>>().Delete(dynamic_cast<Value<Deque>*>(data));
+		break;
+	case DataType::Object:
+		Memory<Value<Object>>().Delete(dynamic_cast<Value<Object>*>(data));
+		break;
+	case DataType::Slice:
+		Memory<Value<Slice>>().Delete(dynamic_cast<Value<Slice>*>(data));
+		break;
+	case DataType::Set:
+		Memory<Value<Set>>().Delete(dynamic_cast<Value<Set>*>(data));
+		break;
+	case DataType::OrderedMap:
+		Memory<Value<OrderedMap>>().Delete(dynamic_cast<Value<OrderedMap>*>(data));
+		break;
 	}
 }
 
-List::List(){}
+List::List()
+{
+	packedType = DataType::Int;
+}
 
 List::List(const List& other)
 {
+	packedType = other.packedType;
+	packedToken = other.packedToken;
+	ints = other.ints;
+	floats = other.floats;
+	bools = other.bools;
+
 	list.reserve(other.list.size());
 	for (auto& elem : other.list)
 	{
@@ -49,7 +76,31 @@ List::List(const List& other)
 
 List& List::operator=(const List& other)
 {
-	list.reserve(other.list.size());
+	if (other.IsPacked() && IsPacked() && (size() == 0 || packedType == other.packedType))
+	{
+		if (size() == 0)
+		{
+			packedType = other.packedType;
+			packedToken = other.packedToken;
+		}
+
+		ints.insert(ints.end(), other.ints.begin(), other.ints.end());
+		floats.insert(floats.end(), other.floats.begin(), other.floats.end());
+		bools.insert(bools.end(), other.bools.begin(), other.bools.end());
+		return *this;
+	}
+
+	Box();
+	if (other.IsPacked())
+	{
+		list.reserve(list.size() + other.size());
+		for (int i = 0; i < other.size(); i++)
+			list.push_back(other.BoxElement(i));
+
+		return *this;
+	}
+
+	list.reserve(list.size() + other.list.size());
 	for (auto& elem : other.list)
 	{
 		Data* copy = nullptr;
@@ -60,32 +111,195 @@ List& List::operator=(const List& other)
 	return *this;
 }
 
+template<>
+void Value<List>::CopyOther(Data* data)
+{
+	if (isConst)
+	{
+		token.PrintError("trying to change a constant variable");
+		return;
+	}
+
+	if (!AffirmSameType(data))
+		return;
+
+	Value<List>* value = dynamic_cast<Value<List>*>(data);
+
+	if (users == nullptr)
+		Init();
+
+	// the copy shares the elements of the list. a packed list has no elements to share, so one that others hold
+	// is boxed first. a packed list held only here, like a fresh result, is copied packed since nobody can tell
+	if (*value->users > 1)
+		value->valuePtr->Box();
+
+	*valuePtr = *value->valuePtr;
+}
+
 List::~List()
 {
 	for (auto& e : list)
 		FreeData(e);//delete e;
 }
 
+bool List::IsPacked() const
+{
+	return packedType != DataType::List;
+}
+
+Data* List::BoxElement(int i) const
+{
+	switch (packedType)
+	{
+	case DataType::Int:
+	{
+		Value<Int>* val = Memory<Value<Int>>().New(DataType::Int, false, packedToken);
+		val->SetValue(ints[i]);
+		return val;
+	}
+	case DataType::Float:
+	{
+		Value<Float>* val = Memory<Value<Float>>().New(DataType::Float, false, packedToken);
+		val->SetValue(floats[i]);
+		return val;
+	}
+	default:
+	{
+		Value<Bool>* val = Memory<Value<Bool>>().New(DataType::Bool, false, packedToken);
+		val->SetValue(bools[i] != 0);
+		return val;
+	}
+	}
+}
+
+void List::Box()
+{
+	if (!IsPacked())
+		return;
+
+	list.reserve(size());
+	for (int i = 0; i < size(); i++)
+		list.push_back(BoxElement(i));
+
+	packedType = DataType::List;
+	std::vector<int>().swap(ints);
+	std::vector<float>().swap(floats);
+	std::vector<char>().swap(bools);
+}
+
+bool List::PushPacked(Data* data)
+{
+	// stores a copy of the value of data if it fits the packed array, data itself is not kept
+	DataType type = data->type;
+	if (!IsPacked() || (type != DataType::Int && type != DataType::Float && type != DataType::Bool))
+		return false;
+
+	if (size() == 0)
+	{
+		packedType = type;
+		packedToken = data->token;
+	}
+	else if (type != packedType)
+		return false;
+
+	if (type == DataType::Int)
+		ints.push_back(*dynamic_cast<Value<Int>*>(data)->valuePtr);
+	else if (type == DataType::Float)
+		floats.push_back(*dynamic_cast<Value<Float>*>(data)->valuePtr);
+	else
+		bools.push_back(*dynamic_cast<Value<Bool>*>(data)->valuePtr ? 1 : 0);
+
+	return true;
+}
+
+void List::AppendRange(const List& other, int start, int count)
+{
+	if (other.IsPacked() && IsPacked() && (size() == 0 || packedType == other.packedType))
+	{
+		if (size() == 0)
+		{
+			packedType = other.packedType;
+			packedToken = other.packedToken;
+		}
+
+		if (other.packedType == DataType::Int)
+			ints.insert(ints.end(), other.ints.begin() + start, other.ints.begin() + start + count);
+		else if (other.packedType == DataType::Float)
+			floats.insert(floats.end(), other.floats.begin() + start, other.floats.begin() + start + count);
+		else
+			bools.insert(bools.end(), other.bools.begin() + start, other.bools.begin() + start + count);
+		return;
+	}
+
+	Box();
+	for (int i = start; i < start + count; i++)
+	{
+		if (other.IsPacked())
+		{
+			list.push_back(other.BoxElement(i));
+			continue;
+		}
+
+		Data* copy = nullptr;
+		other.list[i]->CreateSameType(copy);
+		copy->ReferenceOther(other.list[i]);
+		list.push_back(copy);
+	}
+}
+
 void List::push_back(Data* data)
 {
+	Box();
 	list.push_back(data);
 }
 
 int List::size() const
 {
-	return (int)list.size();
+	switch (packedType)
+	{
+	case DataType::Int:
+		return (int)ints.size();
+	case DataType::Float:
+		return (int)floats.size();
+	case DataType::Bool:
+		return (int)bools.size();
+	default:
+		return (int)list.size();
+	}
 }
 
 Data*& List::operator[](int i)
 {
+	Box();
 	return list[i];
 }
 
 Data*& List::at(int i)
 {
+	Box();
 	return list.at(i);
 }
 
+void List::RemoveAt(int i)
+{
+	switch (packedType)
+	{
+	case DataType::Int:
+		ints.erase(ints.begin() + i);
+		break;
+	case DataType::Float:
+		floats.erase(floats.begin() + i);
+		break;
+	case DataType::Bool:
+		bools.erase(bools.begin() + i);
+		break;
+	default:
+		FreeData(list[i]);//delete list[i];
+		list.erase(list.begin() + i);
+		break;
+	}
+}
+
 void List::erase(const std::vector<Data*>::const_iterator& itr)
 {
 	list.erase(itr);
@@ -93,65 +307,957 @@ void List::erase(const std::vector<Data*>::const_iterator& itr)
 
 std::vector<Data*>::const_iterator List::begin()
 {
+	Box();
 	return list.begin();
 }
 
-Map::Map() {}
+Deque::Deque()
+{
+}
+
+Deque::Deque(const Deque& other)
+{
+	for (auto& elem : other.items)
+	{
+		Data* copy = nullptr;
+		elem->CreateSameType(copy);
+		copy->ReferenceOther(elem);
+		items.push_back(copy);
+	}
+}
+
+Deque& Deque::operator=(const Deque& other)
+{
+	for (auto& elem : other.items)
+	{
+		Data* copy = nullptr;
+		elem->CreateSameType(copy);
+		copy->ReferenceOther(elem);
+		items.push_back(copy);
+	}
+	return *this;
+}
+
+Deque::~Deque()
+{
+	for (auto& e : items)
+		FreeData(e);
+}
+
+int Deque::size() const
+{
+	return (int)items.size();
+}
+
+Data*& Deque::at(int i)
+{
+	return items.at(i);
+}
+
+void Deque::push_back(Data* data)
+{
+	items.push_back(data);
+}
+
+Data* Deque::pop_front()
+{
+	// the caller takes over the element
+	Data* front = items.front();
+	items.pop_front();
+	return front;
+}
+
+Data* Deque::pop_back()
+{
+	Data* back = items.back();
+	items.pop_back();
+	return back;
+}
+
+Object::Object()
+{
+	nativeClass = nullptr;
+	state = nullptr;
+}
+
+Object::Object(const Object& other)
+{
+	nativeClass = other.nativeClass;
+	state = nullptr;
+	if (other.state != nullptr)
+	{
+		other.state->CreateSameType(state);
+		state->ReferenceOther(other.state);
+	}
+}
+
+Object& Object::operator=(const Object& other)
+{
+	if (this == &other)
+		return *this;
+
+	FreeData(state);
+	nativeClass = other.nativeClass;
+	state = nullptr;
+	if (other.state != nullptr)
+	{
+		other.state->CreateSameType(state);
+		state->ReferenceOther(other.state);
+	}
+	return *this;
+}
+
+Object::~Object()
+{
+	FreeData(state);
+}
+
+// the slices viewing (not owning) each string or list storage
+static std::unordered_multimap<const void*, Slice*>& SliceViews()
+{
+	static auto* views = new std::unordered_multimap<const void*, Slice*>();
+	return *views;
+}
+
+static const void* SliceStorage(Data* data)
+{
+	if (data->type == DataType::String)
+		return dynamic_cast<Value<String>*>(data)->valuePtr;
+
+	return dynamic_cast<Value<List>*>(data)->valuePtr;
+}
+
+static int SourceSize(Data* data)
+{
+	if (data->type == DataType::String)
+		return (int)dynamic_cast<Value<String>*>(data)->valuePtr->size();
+
+	return dynamic_cast<Value<List>*>(data)->valuePtr->size();
+}
+
+Slice::Slice()
+{
+	source = nullptr;
+	start = 0;
+	count = 0;
+	owned = false;
+}
+
+Slice::Slice(const Slice& other)
+{
+	source = nullptr;
+	start = 0;
+	count = 0;
+	owned = false;
+	if (other.source != nullptr)
+		View(other.source, other.start, other.size());
+}
+
+Slice& Slice::operator=(const Slice& other)
+{
+	if (this != &other && other.source != nullptr)
+		View(other.source, other.start, other.size());
+
+	return *this;
+}
+
+Slice::~Slice()
+{
+	Release();
+}
+
+void Slice::View(Data* data, int _start, int _count)
+{
+	// a slice of a slice views the same storage
+	if (data->type == DataType::Slice)
+	{
+		Slice& inner = *dynamic_cast<Value<Slice>*>(data)->valuePtr;
+		_start += inner.start;
+		data = inner.source;
+	}
+
+	Data* viewed = nullptr;
+	data->CreateSameType(viewed);
+	viewed->ReferenceOther(data);
+
+	Release();
+	source = viewed;
+	start = _start;
+	count = _count;
+	owned = false;
+	SliceViews().insert({ SliceStorage(source), this });
+}
+
+int Slice::size() const
+{
+	if (source == nullptr)
+		return 0;
+
+	int available = SourceSize(source) - start;
+	if (owned)
+		return available;
+
+	return std::max(0, std::min(count, available));
+}
+
+void Slice::MakeOwned()
+{
+	if (owned || source == nullptr)
+		return;
+
+	Data* copy = nullptr;
+	if (source->type == DataType::String)
+	{
+		Value<String>* str = Memory<Value<String>>().New(DataType::String, false, source->token);
+		str->SetValue(dynamic_cast<Value<String>*>(source)->valuePtr->substr(start, size()));
+		copy = str;
+	}
+	else
+	{
+		Value<List>* list = Memory<Value<List>>().New(DataType::List, false, source->token);
+		list->Init();
+		list->valuePtr->AppendRange(*dynamic_cast<Value<List>*>(source)->valuePtr, start, size());
+		copy = list;
+	}
+
+	Release();
+	source = copy;
+	start = 0;
+	count = 0;
+	owned = true;
+}
+
+void Slice::Release()
+{
+	if (source == nullptr)
+		return;
+
+	if (!owned)
+	{
+		auto range = SliceViews().equal_range(SliceStorage(source));
+		for (auto itr = range.first; itr != range.second; ++itr)
+		{
+			if (itr->second == this)
+			{
+				SliceViews().erase(itr);
+				break;
+			}
+		}
+	}
+
+	FreeData(source);
+	source = nullptr;
+}
+
+void Slice::DetachViews(Data* data)
+{
+	if (SliceViews().empty() || (data->type != DataType::String && data->type != DataType::List))
+		return;
+
+	std::vector<Slice*> views;
+	auto range = SliceViews().equal_range(SliceStorage(data));
+	for (auto itr = range.first; itr != range.second; ++itr)
+		views.push_back(itr->second);
+
+	for (auto& view : views)
+		view->MakeOwned();
+}
+
+const int Map::emptySlot;
+const int Map::erasedSlot;
+
+Map::Map()
+{
+	erasedCount = 0;
+}
 
 Map::Map(const Map& other)
 {
-	map.reserve(other.map.size());
-	for (auto& elem : other.map)
+	erasedCount = 0;
+	entries.reserve(other.entries.size() - other.erasedCount);
+	for (auto& elem : other.entries)
 	{
+		if (elem.erased)
+			continue;
+
 		Data* copy = nullptr;
-		elem.second->CreateSameType(copy);
-		copy->ReferenceOther(elem.second);
-		map[elem.first] = copy;
+		elem.value->CreateSameType(copy);
+		copy->ReferenceOther(elem.value);
+		entries.push_back({ elem.key, copy, elem.hash, false });
 	}
+
+	// the keys are already unique, the index is rebuilt from the cached hashes
+	if (!entries.empty())
+		Rebuild(other.slots.size());
 }
 
 Map& Map::operator=(const Map& other)
 {
-	map.reserve(other.map.size());
-	for (auto& elem : other.map)
+	for (auto& elem : other.entries)
 	{
+		if (elem.erased)
+			continue;
+
 		Data* copy = nullptr;
-		elem.second->CreateSameType(copy);
-		copy->ReferenceOther(elem.second);
-		map[elem.first] = copy;
+		elem.value->CreateSameType(copy);
+		copy->ReferenceOther(elem.value);
+
+		int i = FindEntry(elem.key, elem.hash);
+		if (i < 0)
+			AddEntry(elem.key, copy, elem.hash);
+		else
+			entries[i].value = copy;
 	}
 	return *this;
 }
 
 Map::~Map()
 {
-	for (auto& e : map)
-		FreeData(e.second);//delete e.second;
+	for (auto& e : entries)
+		if (!e.erased)
+			FreeData(e.value);//delete e.second;
 }
 
-void Map::insert(const std::pair<std::string, Data*>& pair)
+bool Map::insert(const std::pair<std::string, Data*>& pair)
 {
-	map.insert(pair);
+	size_t hash = std::hash<std::string>()(pair.first);
+	if (FindEntry(pair.first, hash) >= 0)
+		return false;
+
+	AddEntry(pair.first, pair.second, hash);
+	return true;
 }
 
 int Map::count(const std::string& key)
 {
-	return map.count(key);
+	return FindEntry(key, std::hash<std::string>()(key)) >= 0 ? 1 : 0;
 }
 
 Data*& Map::operator[](const std::string& key)
 {
-	return map[key];
+	size_t hash = std::hash<std::string>()(key);
+	int i = FindEntry(key, hash);
+	if (i < 0)
+		i = AddEntry(key, nullptr, hash);
+
+	return entries[i].value;
 }
 
 Data*& Map::at(const std::string& key)
 {
-	return map.at(key);
+	int i = FindEntry(key, std::hash<std::string>()(key));
+	if (i < 0)
+		throw std::out_of_range("Map::at");
+
+	return entries[i].value;
 }
 
 void Map::erase(const std::string& key)
 {
-	map.erase(key);
+	size_t hash = std::hash<std::string>()(key);
+	if (slots.empty())
+		return;
+
+	size_t mask = slots.size() - 1;
+	for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+	{
+		int i = slots[slot];
+		if (i == emptySlot)
+			return;
+
+		if (i >= 0 && entries[i].hash == hash && entries[i].key == key)
+		{
+			slots[slot] = erasedSlot;
+			entries[i].erased = true;
+			entries[i].value = nullptr;
+			entries[i].key.clear();
+			erasedCount++;
+			break;
+		}
+	}
+
+	if (erasedCount * 2 > (int)entries.size())
+		Rebuild(slots.size());
+}
+
+int Map::size() const
+{
+	return (int)entries.size() - erasedCount;
+}
+
+Map::Iterator Map::begin()
+{
+	Iterator itr = { entries.data(), entries.data() + entries.size() };
+	if (itr.entry != itr.last && itr.entry->erased)
+		++itr;
+
+	return itr;
+}
+
+Map::Iterator Map::end()
+{
+	return { entries.data() + entries.size(), entries.data() + entries.size() };
+}
+
+MapEntry& Map::Iterator::operator*() const
+{
+	return *entry;
+}
+
+MapEntry* Map::Iterator::operator->() const
+{
+	return entry;
+}
+
+Map::Iterator& Map::Iterator::operator++()
+{
+	do
+		entry++;
+	while (entry != last && entry->erased);
+
+	return *this;
+}
+
+bool Map::Iterator::operator!=(const Iterator& other) const
+{
+	return entry != other.entry;
+}
+
+int Map::FindEntry(const std::string& key, size_t hash)
+{
+	if (slots.empty())
+		return -1;
+
+	size_t mask = slots.size() - 1;
+	for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+	{
+		int i = slots[slot];
+		if (i == emptySlot)
+			return -1;
+
+		// the cached hash rules out almost every other key without touching its string
+		if (i >= 0 && entries[i].hash == hash && entries[i].key == key)
+			return i;
+	}
+}
+
+int Map::AddEntry(const std::string& key, Data* value, size_t hash)
+{
+	// erased entries keep their slots as tombstones, so they count towards the load factor
+	if ((entries.size() + 1) * 4 > slots.size() * 3)
+		Rebuild(std::max((size_t)8, slots.size() * 2));
+
+	int i = (int)entries.size();
+	entries.push_back({ key, value, hash, false });
+
+	size_t mask = slots.size() - 1;
+	size_t slot = hash & mask;
+	for (; slots[slot] >= 0; slot = (slot + 1) & mask);
+
+	slots[slot] = i;
+	return i;
+}
+
+void Map::Rebuild(size_t slotCount)
+{
+	if (erasedCount > 0)
+	{
+		entries.erase(std::remove_if(entries.begin(), entries.end(), [](const MapEntry& e) { return e.erased; }), entries.end());
+		erasedCount = 0;
+	}
+
+	while (slotCount < 8 || entries.size() * 4 > slotCount * 3)
+		slotCount = std::max((size_t)8, slotCount * 2);
+
+	slots.assign(slotCount, emptySlot);
+	size_t mask = slotCount - 1;
+	for (int i = 0; i < (int)entries.size(); i++)
+	{
+		size_t slot = entries[i].hash & mask;
+		for (; slots[slot] != emptySlot; slot = (slot + 1) & mask);
+
+		slots[slot] = i;
+	}
+}
+
+SetItem SetItem::FromInt(int number)
+{
+	// std::hash<int> is the identity, the bits are mixed so that ints with equal low bits don't share a probe chain
+	unsigned long long h = (unsigned int)number;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return { std::string(), (size_t)h, number, true };
+}
+
+SetItem SetItem::FromString(const std::string& text)
+{
+	return { text, std::hash<std::string>()(text), 0, false };
+}
+
+bool SetItem::operator==(const SetItem& other) const
+{
+	if (hash != other.hash || isInt != other.isInt)
+		return false;
+
+	return isInt ? number == other.number : text == other.text;
+}
+
+bool SetItem::operator<(const SetItem& other) const
+{
+	if (isInt != other.isInt)
+		return isInt;
+
+	return isInt ? number < other.number : text < other.text;
+}
+
+const int Set::emptySlot;
+const int Set::erasedSlot;
+
+Set::Set()
+{
+	erasedSlots = 0;
+}
+
+Set& Set::operator=(const Set& other)
+{
+	if (&other == this)
+		return *this;
+
+	// nothing to merge with, the index is taken over as it is
+	if (items.empty())
+	{
+		items = other.items;
+		slots = other.slots;
+		erasedSlots = other.erasedSlots;
+		return *this;
+	}
+
+	for (auto& item : other.items)
+		insert(item);
+	return *this;
+}
+
+bool Set::insert(const SetItem& item)
+{
+	if (FindSlot(item) >= 0)
+		return false;
+
+	// erased slots lengthen the probe chains too, they are cleared out without growing when they are the reason
+	if ((items.size() + erasedSlots + 1) * 4 > slots.size() * 3)
+		Rebuild((items.size() + 1) * 4 > slots.size() * 3 ? std::max((size_t)8, slots.size() * 2) : slots.size());
+
+	size_t mask = slots.size() - 1;
+	size_t slot = item.hash & mask;
+	for (; slots[slot] >= 0; slot = (slot + 1) & mask);
+
+	if (slots[slot] == erasedSlot)
+		erasedSlots--;
+
+	slots[slot] = (int)items.size();
+	items.push_back(item);
+	return true;
+}
+
+bool Set::contains(const SetItem& item) const
+{
+	return FindSlot(item) >= 0;
+}
+
+bool Set::remove(const SetItem& item)
+{
+	int slot = FindSlot(item);
+	if (slot < 0)
+		return false;
+
+	int i = slots[slot];
+	slots[slot] = erasedSlot;
+	erasedSlots++;
+
+	int last = (int)items.size() - 1;
+	if (i != last)
+	{
+		slots[FindSlot(items[last])] = i;
+		items[i] = std::move(items[last]);
+	}
+	items.pop_back();
+
+	if (erasedSlots * 4 > (int)slots.size())
+		Rebuild(slots.size());
+
+	return true;
+}
+
+int Set::size() const
+{
+	return (int)items.size();
+}
+
+int Set::FindSlot(const SetItem& item) const
+{
+	if (slots.empty())
+		return -1;
+
+	size_t mask = slots.size() - 1;
+	for (size_t slot = item.hash & mask;; slot = (slot + 1) & mask)
+	{
+		int i = slots[slot];
+		if (i == emptySlot)
+			return -1;
+
+		if (i >= 0 && items[i] == item)
+			return (int)slot;
+	}
+}
+
+void Set::Rebuild(size_t slotCount)
+{
+	while (slotCount < 8 || items.size() * 4 > slotCount * 3)
+		slotCount = std::max((size_t)8, slotCount * 2);
+
+	slots.assign(slotCount, emptySlot);
+	erasedSlots = 0;
+	size_t mask = slotCount - 1;
+	for (int i = 0; i < (int)items.size(); i++)
+	{
+		size_t slot = items[i].hash & mask;
+		for (; slots[slot] != emptySlot; slot = (slot + 1) & mask);
+
+		slots[slot] = i;
+	}
+}
+
+int OrderedMapNode::EntryCount() const
+{
+	if (isLeaf)
+		return (int)keys.size();
+
+	int total = 0;
+	for (auto& c : counts)
+		total += c;
+	return total;
+}
+
+const int OrderedMap::nodeCapacity;
+
+OrderedMap::OrderedMap()
+{
+	root = NewNode(true);
+	count = 0;
+}
+
+OrderedMap::OrderedMap(const OrderedMap& other)
+{
+	OrderedMapNode* lastLeaf = nullptr;
+	root = CopyNode(other.root, lastLeaf);
+	count = other.count;
+}
+
+OrderedMap& OrderedMap::operator=(const OrderedMap& other)
+{
+	if (&other == this)
+		return *this;
+
+	for (OrderedMapNode* leaf = other.FirstLeaf(); leaf != nullptr; leaf = leaf->next)
+	{
+		for (int i = 0; i < (int)leaf->keys.size(); i++)
+		{
+			Data* copy = nullptr;
+			leaf->values[i]->CreateSameType(copy);
+			copy->ReferenceOther(leaf->values[i]);
+
+			Data*& value = (*this)[leaf->keys[i]];
+			FreeData(value);
+			value = copy;
+		}
+	}
+	return *this;
+}
+
+OrderedMap::~OrderedMap()
+{
+	FreeNode(root);
+}
+
+Data*& OrderedMap::operator[](const SetItem& key)
+{
+	Data** value = Find(key);
+	if (value == nullptr)
+	{
+		insert(key, nullptr);
+		value = Find(key);
+	}
+	return *value;
+}
+
+Data** OrderedMap::Find(const SetItem& key) const
+{
+	OrderedMapNode* node = root;
+	while (!node->isLeaf)
+		node = node->children[ChildIndex(node, key)];
+
+	auto itr = std::lower_bound(node->keys.begin(), node->keys.end(), key);
+	if (itr == node->keys.end() || !(*itr == key))
+		return nullptr;
+
+	return &node->values[itr - node->keys.begin()];
+}
+
+bool OrderedMap::insert(const SetItem& key, Data* value)
+{
+	OrderedMapNode* split = nullptr;
+	if (!Insert(root, key, value, split))
+		return false;
+
+	count++;
+	if (split != nullptr)
+	{
+		OrderedMapNode* newRoot = NewNode(false);
+		newRoot->keys = { root->keys[0], split->keys[0] };
+		newRoot->children = { root, split };
+		newRoot->counts = { root->EntryCount(), split->EntryCount() };
+		root = newRoot;
+	}
+	return true;
+}
+
+bool OrderedMap::erase(const SetItem& key)
+{
+	// the value is not freed, like Map::erase
+	if (!Erase(root, key))
+		return false;
+
+	count--;
+	while (!root->isLeaf && root->children.size() == 1)
+	{
+		OrderedMapNode* child = root->children[0];
+		delete root;
+		root = child;
+	}
+	return true;
+}
+
+int OrderedMap::size() const
+{
+	return count;
+}
+
+int OrderedMap::LowerBound(const SetItem& key, bool inclusive) const
+{
+	// the position of the first key that is not less than key (inclusive) or greater than key
+	int position = 0;
+	OrderedMapNode* node = root;
+	while (!node->isLeaf)
+	{
+		int c = ChildIndex(node, key);
+		for (int i = 0; i < c; i++)
+			position += node->counts[i];
+		node = node->children[c];
+	}
+
+	auto itr = inclusive ? std::lower_bound(node->keys.begin(), node->keys.end(), key) : std::upper_bound(node->keys.begin(), node->keys.end(), key);
+	return position + (int)(itr - node->keys.begin());
+}
+
+OrderedMapNode* OrderedMap::LeafAt(int& inOutIndex) const
+{
+	// inOutIndex goes in as a position in the map and comes out as a position in the returned leaf
+	OrderedMapNode* node = root;
+	while (!node->isLeaf)
+	{
+		int c = 0;
+		for (; c + 1 < (int)node->children.size() && inOutIndex >= node->counts[c]; c++)
+			inOutIndex -= node->counts[c];
+		node = node->children[c];
+	}
+	return node;
+}
+
+OrderedMapNode* OrderedMap::FirstLeaf() const
+{
+	OrderedMapNode* node = root;
+	while (!node->isLeaf)
+		node = node->children[0];
+	return node;
+}
+
+OrderedMapNode* OrderedMap::NewNode(bool isLeaf)
+{
+	OrderedMapNode* node = new OrderedMapNode();
+	node->next = nullptr;
+	node->isLeaf = isLeaf;
+	return node;
+}
+
+OrderedMapNode* OrderedMap::CopyNode(const OrderedMapNode* node, OrderedMapNode*& inOutLastLeaf)
+{
+	OrderedMapNode* copy = NewNode(node->isLeaf);
+	copy->keys = node->keys;
+	copy->counts = node->counts;
+	copy->values.reserve(node->values.size());
+	for (auto& value : node->values)
+	{
+		Data* valueCopy = nullptr;
+		value->CreateSameType(valueCopy);
+		valueCopy->ReferenceOther(value);
+		copy->values.push_back(valueCopy);
+	}
+
+	copy->children.reserve(node->children.size());
+	for (auto& child : node->children)
+		copy->children.push_back(CopyNode(child, inOutLastLeaf));
+
+	// leaves are copied from left to right, each one is linked after the one copied before it
+	if (copy->isLeaf)
+	{
+		if (inOutLastLeaf != nullptr)
+			inOutLastLeaf->next = copy;
+		inOutLastLeaf = copy;
+	}
+	return copy;
+}
+
+void OrderedMap::FreeNode(OrderedMapNode* node)
+{
+	for (auto& value : node->values)
+		FreeData(value);
+	for (auto& child : node->children)
+		FreeNode(child);
+	delete node;
+}
+
+int OrderedMap::ChildIndex(const OrderedMapNode* node, const SetItem& key)
+{
+	// the last child whose lower bound is not greater than key, keys below every bound go to the first child
+	int i = (int)(std::upper_bound(node->keys.begin(), node->keys.end(), key) - node->keys.begin()) - 1;
+	return std::max(i, 0);
+}
+
+bool OrderedMap::Insert(OrderedMapNode* node, const SetItem& key, Data* value, OrderedMapNode*& outSplit)
+{
+	outSplit = nullptr;
+	if (node->isLeaf)
+	{
+		auto itr = std::lower_bound(node->keys.begin(), node->keys.end(), key);
+		if (itr != node->keys.end() && *itr == key)
+			return false;
+
+		int i = (int)(itr - node->keys.begin());
+		node->keys.insert(itr, key);
+		node->values.insert(node->values.begin() + i, value);
+	}
+	else
+	{
+		int i = ChildIndex(node, key);
+		OrderedMapNode* split = nullptr;
+		if (!Insert(node->children[i], key, value, split))
+			return false;
+
+		node->counts[i]++;
+		if (key < node->keys[i])
+			node->keys[i] = key;
+
+		if (split != nullptr)
+		{
+			node->counts[i] = node->children[i]->EntryCount();
+			node->keys.insert(node->keys.begin() + i + 1, split->keys[0]);
+			node->children.insert(node->children.begin() + i + 1, split);
+			node->counts.insert(node->counts.begin() + i + 1, split->EntryCount());
+		}
+	}
+
+	if ((int)node->keys.size() <= nodeCapacity)
+		return true;
+
+	// the upper half moves to a new node that goes right after this one
+	int half = (int)node->keys.size() / 2;
+	OrderedMapNode* sibling = NewNode(node->isLeaf);
+	sibling->keys.assign(node->keys.begin() + half, node->keys.end());
+	node->keys.resize(half);
+	if (node->isLeaf)
+	{
+		sibling->values.assign(node->values.begin() + half, node->values.end());
+		node->values.resize(half);
+		sibling->next = node->next;
+		node->next = sibling;
+	}
+	else
+	{
+		sibling->children.assign(node->children.begin() + half, node->children.end());
+		node->children.resize(half);
+		sibling->counts.assign(node->counts.begin() + half, node->counts.end());
+		node->counts.resize(half);
+	}
+
+	outSplit = sibling;
+	return true;
+}
+
+bool OrderedMap::Erase(OrderedMapNode* node, const SetItem& key)
+{
+	if (node->isLeaf)
+	{
+		auto itr = std::lower_bound(node->keys.begin(), node->keys.end(), key);
+		if (itr == node->keys.end() || !(*itr == key))
+			return false;
+
+		node->values.erase(node->values.begin() + (itr - node->keys.begin()));
+		node->keys.erase(itr);
+		return true;
+	}
+
+	// the lower bounds are left as they are, a bound below the smallest key of its child still routes correctly
+	int i = ChildIndex(node, key);
+	OrderedMapNode* child = node->children[i];
+	if (!Erase(child, key))
+		return false;
+
+	node->counts[i]--;
+	if ((int)child->keys.size() >= nodeCapacity / 4 || node->children.size() < 2)
+		return true;
+
+	// a child that got small is merged with a neighbour if both fit in one node
+	int left = (i + 1 < (int)node->children.size()) ? i : i - 1;
+	OrderedMapNode* a = node->children[left];
+	OrderedMapNode* b = node->children[left + 1];
+	if ((int)(a->keys.size() + b->keys.size()) > nodeCapacity)
+		return true;
+
+	a->keys.insert(a->keys.end(), b->keys.begin(), b->keys.end());
+	if (a->isLeaf)
+	{
+		a->values.insert(a->values.end(), b->values.begin(), b->values.end());
+		a->next = b->next;
+	}
+	else
+	{
+		a->children.insert(a->children.end(), b->children.begin(), b->children.end());
+		a->counts.insert(a->counts.end(), b->counts.begin(), b->counts.end());
+	}
+
+	node->counts[left] += node->counts[left + 1];
+	node->keys.erase(node->keys.begin() + left + 1);
+	node->children.erase(node->children.begin() + left + 1);
+	node->counts.erase(node->counts.begin() + left + 1);
+	delete b;
+	return true;
+}
+
+VariableName::VariableName(Symbol _symbol)
+{
+	symbol = _symbol;
+}
+
+VariableName::VariableName(const std::string& _text)
+{
+	symbol = Symbol::Find(_text);
+	if (symbol.IsNull())
+		text = _text;
+}
+
+const std::string& VariableName::Text() const
+{
+	return symbol.IsNull() ? text : symbol.Text();
 }
 
 Function::Function()
@@ -159,6 +1265,9 @@ Function::Function()
 	parent = nullptr;
 	returnValue = nullptr;
 	function = nullptr;
+	bodyScript = nullptr;
+	bodyOpeningLexeme = 0;
+	bodyBroken = false;
 }
 
 Function::Function(void(*_function)(Function*))
@@ -166,10 +1275,16 @@ Function::Function(void(*_function)(Function*))
 	parent = nullptr;
 	returnValue = nullptr;
 	function = _function;
+	bodyScript = nullptr;
+	bodyOpeningLexeme = 0;
+	bodyBroken = false;
 }
 
 Function::Function(const Function& other)
 {
+	// a copy takes the parsed body instead of parsing it again from a script it may outlive
+	const_cast<Function&>(other).ParseBody();
+
 	parent = nullptr;
 	returnValue = nullptr;
 	for (auto& arg : other.arguments)
@@ -182,10 +1297,16 @@ Function::Function(const Function& other)
 
 	function = other.function;
 	parameterNames = other.parameterNames;
+	bodyScript = nullptr;
+	bodyOpeningLexeme = 0;
+	bodyBroken = other.bodyBroken;
 }
 
 Function& Function::operator=(const Function& other)
 {
+	// a copy takes the parsed body instead of parsing it again from a script it may outlive
+	const_cast<Function&>(other).ParseBody();
+
 	parent = nullptr;
 	returnValue = nullptr;
 	for (auto& arg : other.arguments)
@@ -198,21 +1319,29 @@ Function& Function::operator=(const Function& other)
 
 	function = other.function;
 	parameterNames = other.parameterNames;
+	bodyScript = nullptr;
+	bodyOpeningLexeme = 0;
+	bodyBroken = other.bodyBroken;
 
 	return *this;
 }
 
 Function::~Function()
 {
+	if (bodyScript != nullptr)
+		bodyScript->unparsedBodies.erase(this);
+
+	FreeVariables();
+
 	for (auto& arg : arguments)
 		FreeData(arg);//delete arg;
 
 	FreeData(returnValue);//delete returnValue;
 }
 
-bool Function::GetVariableOwner(const std::string& name, Function*& outOwner)
+bool Function::GetVariableOwner(const VariableName& name, Function*& outOwner)
 {
-	if (variables.count(name) != 0)
+	if ((!name.symbol.IsNull() && variables.count(name.symbol) != 0) || (!textVariables.empty() && textVariables.count(name.Text()) != 0))
 	{
 		outOwner = this;
 		return true;
@@ -224,22 +1353,80 @@ bool Function::GetVariableOwner(const std::string& name, Function*& outOwner)
 	return false;
 }
 
-bool Function::GetVariable(const std::string& name, Data*& outVar)
+bool Function::GetVariable(const VariableName& name, Data*& outVar)
+{
+	// most scopes hold no variables at all, those are passed without hashing
+	for (Function* scope = this; scope != nullptr; scope = scope->parent)
+	{
+		if (!scope->variables.empty() && !name.symbol.IsNull())
+		{
+			auto itr = scope->variables.find(name.symbol);
+			if (itr != scope->variables.end())
+			{
+				outVar = itr->second;
+				return true;
+			}
+		}
+
+		// a text name may have been interned since the variable was added, so symbols are looked up here too
+		if (!scope->textVariables.empty())
+		{
+			auto itr = scope->textVariables.find(name.Text());
+			if (itr != scope->textVariables.end())
+			{
+				outVar = itr->second;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool Function::AddVariable(const VariableName& name, Data* var)
 {
-	Function* owner = nullptr;
-	if (!GetVariableOwner(name, owner))
+	// a name that was never interned cannot be among the symbol keyed variables
+	if (name.symbol.IsNull())
+		return textVariables.insert({ name.text, var }).second;
+
+	if (!textVariables.empty() && textVariables.count(name.symbol.Text()) != 0)
 		return false;
 
-	outVar = owner->variables[name];
-	return true;
+	return variables.insert({ name.symbol, var }).second;
 }
 
-bool Function::AddVariable(const std::string& name, Data* var)
+bool Function::RemoveVariable(const VariableName& name)
 {
-	if (variables.count(name) != 0)
+	if (!name.symbol.IsNull())
+	{
+		auto itr = variables.find(name.symbol);
+		if (itr != variables.end())
+		{
+			FreeData(itr->second);
+			variables.erase(itr);
+			return true;
+		}
+	}
+
+	auto itr = textVariables.find(name.Text());
+	if (itr == textVariables.end())
 		return false;
 
-	variables[name] = var;
+	FreeData(itr->second);
+	textVariables.erase(itr);
+	return true;
+}
+
+void Function::FreeVariables()
+{
+	for (auto& v : variables)
+		FreeData(v.second);//delete v.second;
+
+	for (auto& v : textVariables)
+		FreeData(v.second);
+
+	variables.clear();
+	textVariables.clear();
 }
 
 void Function::AddArgument(Data* data)
@@ -251,17 +1438,30 @@ void Function::AddArgument(Data* data)
 	arguments.push_back(data);
 }
 
+bool Function::ParseBody()
+{
+	if (bodyScript != nullptr && !bodyScript->ParseFunctionBody(this))
+		bodyBroken = true;
+
+	return !bodyBroken;
+}
+
 void Function::Call()
+{
+	CallAndKeepVariables();
+	FreeVariables();
+}
+
+void Function::CallAndKeepVariables()
 {
 	FreeData(returnValue);//delete returnValue;
 	returnValue = nullptr;
 
-	function(this);
-
-	for (auto& v : variables)
-		FreeData(v.second);//delete v.second;
+	// the parse error was reported when the body was parsed, running only part of it would hide it
+	if (!ParseBody())
+		return;
 
-	variables.clear();
+	function(this);
 }
 
 bool Function::CheckArgumens(int count)
@@ -1,14 +1,25 @@
 #pragma once
 #include "data.h"
+#include "symbol.h"
 #include <vector>
+#include <deque>
 #include <string>
 #include <unordered_map>
 
 void FreeData(Data* data);
 
+// a list holding only ints, floats or bools keeps their values packed in a plain array (packedType says which).
+// pushing anything else, pushing a reference or handing out an element by reference boxes every element into list,
+// and the list stays boxed from then on. a copy of a list shares its elements, so copying a packed list that can
+// be reached from elsewhere boxes it first (see Value<List>::CopyOther). BoxElement reads without boxing.
 struct List
 {
 	std::vector<Data*> list;
+	DataType packedType;
+	Token packedToken;
+	std::vector<int> ints;
+	std::vector<float> floats;
+	std::vector<char> bools;
 
 	List();
 
@@ -18,6 +29,16 @@ struct List
 
 	~List();
 
+	bool IsPacked() const;
+
+	Data* BoxElement(int i) const;
+
+	void Box();
+
+	bool PushPacked(Data* data);
+
+	void AppendRange(const List& other, int start, int count);
+
 	void push_back(Data* data);
 
 	int size() const;
@@ -26,14 +47,113 @@ struct List
 
 	Data*& at(int i);
 
+	void RemoveAt(int i);
+
 	void erase(const std::vector<Data*>::const_iterator& itr);
 
 	std::vector<Data*>::const_iterator begin();
 };
 
+// elements are owned by the deque and shared on copy like the elements of a boxed list
+struct Deque
+{
+	std::deque<Data*> items;
+
+	Deque();
+
+	Deque(const Deque& other);
+
+	Deque& operator=(const Deque& other);
+
+	~Deque();
+
+	int size() const;
+
+	Data*& at(int i);
+
+	void push_back(Data* data);
+
+	Data* pop_front();
+
+	Data* pop_back();
+};
+
+// an instance of a NativeClass, copies share the state like the elements of a copied map are shared
+struct Object
+{
+	const struct NativeClass* nativeClass;
+	Data* state;
+
+	Object();
+
+	Object(const Object& other);
+
+	Object& operator=(const Object& other);
+
+	~Object();
+};
+
+// a window on part of a string or list, made by slice(). source references the viewed value, so its storage
+// stays alive through the users count. a slice takes its own copy of the window (owned) before it is changed,
+// and before the value it views is changed (see DetachViews), so a slice never sees later changes.
+struct Slice
+{
+	Data* source;
+	int start;
+	int count;
+	bool owned;
+
+	Slice();
+
+	Slice(const Slice& other);
+
+	Slice& operator=(const Slice& other);
+
+	~Slice();
+
+	void View(Data* data, int _start, int _count);
+
+	int size() const;
+
+	void MakeOwned();
+
+	void Release();
+
+	static void DetachViews(Data* data);
+};
+
+struct MapEntry
+{
+	std::string key;
+	Data* value;
+	size_t hash;
+	bool erased;
+};
+
+// entries are stored densely in insertion order, slots is an open addressing (linear probing) index into them.
+// erased entries stay in place as holes until more than half of the entries are holes.
 struct Map
 {
-	std::unordered_map<std::string, Data*> map;
+	std::vector<MapEntry> entries;
+	std::vector<int> slots;
+	int erasedCount;
+
+	static const int emptySlot = -1;
+	static const int erasedSlot = -2;
+
+	struct Iterator
+	{
+		MapEntry* entry;
+		MapEntry* last;
+
+		MapEntry& operator*() const;
+
+		MapEntry* operator->() const;
+
+		Iterator& operator++();
+
+		bool operator!=(const Iterator& other) const;
+	};
 
 	Map();
 
@@ -43,7 +163,7 @@ struct Map
 
 	~Map();
 
-	void insert(const std::pair<std::string, Data*>& pair);
+	bool insert(const std::pair<std::string, Data*>& pair);
 
 	int count(const std::string& key);
 
@@ -52,6 +172,139 @@ struct Map
 	Data*& at(const std::string& key);
 
 	void erase(const std::string& key);
+
+	int size() const;
+
+	Iterator begin();
+
+	Iterator end();
+
+	int FindEntry(const std::string& key, size_t hash);
+
+	int AddEntry(const std::string& key, Data* value, size_t hash);
+
+	void Rebuild(size_t slotCount);
+};
+
+// an int or a string, the items of a Set and the keys of an OrderedMap. ints sort before strings
+struct SetItem
+{
+	std::string text;
+	size_t hash;
+	int number;
+	bool isInt;
+
+	static SetItem FromInt(int number);
+
+	static SetItem FromString(const std::string& text);
+
+	bool operator==(const SetItem& other) const;
+
+	bool operator<(const SetItem& other) const;
+};
+
+// a set of ints and strings. the items are plain values stored densely, slots indexes them like the slots of a Map.
+// remove moves the last item into the hole, so items keep their insertion order until something is removed.
+// copying a set into another adds its items, like copying a map adds its entries.
+struct Set
+{
+	std::vector<SetItem> items;
+	std::vector<int> slots;
+	int erasedSlots;
+
+	static const int emptySlot = -1;
+	static const int erasedSlot = -2;
+
+	Set();
+
+	Set& operator=(const Set& other);
+
+	bool insert(const SetItem& item);
+
+	bool contains(const SetItem& item) const;
+
+	bool remove(const SetItem& item);
+
+	int size() const;
+
+	int FindSlot(const SetItem& item) const;
+
+	void Rebuild(size_t slotCount);
+};
+
+// a node of an OrderedMap. a leaf holds sorted keys with their values and links to the next leaf. a branch holds
+// its children with the number of entries under each, keys[i] is a lower bound of the keys under children[i]
+struct OrderedMapNode
+{
+	std::vector<SetItem> keys;
+	std::vector<Data*> values;
+	std::vector<OrderedMapNode*> children;
+	std::vector<int> counts;
+	OrderedMapNode* next;
+	bool isLeaf;
+
+	int EntryCount() const;
+};
+
+// entries sorted by key in a B+ tree, so the smallest key, a range of keys or the entry at a position are found
+// in one walk from the root. underfull nodes are merged with a neighbour on erase. values are shared on copy
+// like the values of a Map.
+struct OrderedMap
+{
+	OrderedMapNode* root;
+	int count;
+
+	static const int nodeCapacity = 32;
+
+	OrderedMap();
+
+	OrderedMap(const OrderedMap& other);
+
+	OrderedMap& operator=(const OrderedMap& other);
+
+	~OrderedMap();
+
+	Data*& operator[](const SetItem& key);
+
+	Data** Find(const SetItem& key) const;
+
+	bool insert(const SetItem& key, Data* value);
+
+	bool erase(const SetItem& key);
+
+	int size() const;
+
+	int LowerBound(const SetItem& key, bool inclusive) const;
+
+	OrderedMapNode* LeafAt(int& inOutIndex) const;
+
+	OrderedMapNode* FirstLeaf() const;
+
+	static OrderedMapNode* NewNode(bool isLeaf);
+
+	static OrderedMapNode* CopyNode(const OrderedMapNode* node, OrderedMapNode*& inOutLastLeaf);
+
+	static void FreeNode(OrderedMapNode* node);
+
+	static int ChildIndex(const OrderedMapNode* node, const SetItem& key);
+
+	static bool Insert(OrderedMapNode* node, const SetItem& key, Data* value, OrderedMapNode*& outSplit);
+
+	static bool Erase(OrderedMapNode* node, const SetItem& key);
+};
+
+// the name of a variable. a name the lexer saw is an interned symbol, a name made at run time that was never
+// interned keeps its own text instead, so running a script never grows the symbol table
+struct VariableName
+{
+	Symbol symbol;
+	std::string text;
+
+	VariableName(Symbol _symbol);
+
+	VariableName(const std::string& _text);
+
+	const std::string& Text() const;
 };
 
 struct Function
@@ -60,8 +313,18 @@ struct Function
 	Data* returnValue;
 	std::vector<Data*> arguments;
 	void (*function)(Function*);
-	std::unordered_map<std::string, Data*> variables;
-	std::vector<std::string> parameterNames;
+	std::unordered_map<Symbol, Data*> variables;
+	// variables whose names were never interned, see VariableName
+	std::unordered_map<std::string, Data*> textVariables;
+	std::vector<VariableName> parameterNames;
+	// the interned variable name of a call like get("x") whose name is a literal, looked up on its first call
+	Symbol nameSymbol;
+	// set while the body of a function(...) is still unparsed, it is parsed on the first call, when the function
+	// is copied or when its script is destroyed
+	struct Script* bodyScript;
+	int bodyOpeningLexeme;
+	// set when the body failed to parse, such a function is never run
+	bool bodyBroken;
 
 	Function();
 
@@ -73,15 +336,24 @@ struct Function
 
 	~Function();
 
-	bool GetVariableOwner(const std::string& name, Function*& outOwner);
+	bool GetVariableOwner(const VariableName& name, Function*& outOwner);
+
+	bool GetVariable(const VariableName& name, Data*& outVar);
 
-	bool GetVariable(const std::string& name, Data*& outVar);
+	bool AddVariable(const VariableName& name, Data* var);
 
-	bool AddVariable(const std::string& name, Data* var);
+	bool RemoveVariable(const VariableName& name);
+
+	void FreeVariables();
 
 	void AddArgument(Data* data);
 
+	bool ParseBody();
+
 	void Call();
 
+	// like Call, but the variables stay until FreeVariables, used for the root scope of a script
+	void CallAndKeepVariables();
+
 	bool CheckArgumens(int count);
 };
\ No newline at end of file